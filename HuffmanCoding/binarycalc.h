@@ -5,11 +5,12 @@
 #pragma once
 
 #include <string>
+#include <climits>
 #include <type_traits>
 
 template<
 	typename int_t,
-	class = std::enable_if<std::is_integral<int_t>::value>::type
+	class = typename std::enable_if<std::is_integral<int_t>::value>::type
 >
 static std::string decimalToBinary(int_t x)
 {
@@ -1,5 +1,8 @@
 /*
 	Binary tree class
+
+	Nodes are stored in one array of child pairs, with node values in a separate array, so walking the tree
+	only touches the child pairs. A node with no children is a leaf.
 */
 
 #pragma once
@@ -8,121 +11,106 @@
 #include <ostream>
 #include <istream>
 #include <cassert>
+#include <type_traits>
 
 template<
 	typename value_t,
-	typename = is_default_constructible<value_t>::type
+	typename = typename std::is_default_constructible<value_t>::type
 >
 class BinaryTree
 {
 public:
 
+	//Node ids start at 1, an id of 0 is no node
 	typedef unsigned int NodeId;
 
-private:
-
-	struct Node
+	//Children of a node, the left child is followed by the right child
+	struct Children
 	{
-		//Value of node
-		value_t value;
-
-		//Index of left child node
-		NodeId left = 0;
-		//Index of right child node
-		NodeId right = 0;
-
-		Node() :
-			value(value_t())
-		{}
+		NodeId node[2] = {};
 
-		Node(const value_t& v) :
-			value(v)
-		{}
+		NodeId left() const { return node[0]; }
+		NodeId right() const { return node[1]; }
 
-		Node(value_t&& v) :
-			value(v)
-		{}
+		bool empty() const { return (node[0] | node[1]) == 0; }
 	};
 
-	std::vector<Node> m_nodes;
+private:
+
+	std::vector<Children> m_children;
+	std::vector<value_t> m_values;
 
 	bool validateId(NodeId id) const
 	{
-		bool expr = (id <= m_nodes.size() && (id > 0));
-
-		//if (!expr) throw logic_error("Invalid tree node id");
-
-		return expr;
+		return (id <= m_children.size() && (id > 0));
 	}
 
-	bool getNode(NodeId id, Node& node) const
-	{
-		if (!validateId(id))
-			return false;
-
-		node = m_nodes.at((size_t)id - 1);
+public:
 
-		return true;
+	//Reserve space for a number of nodes so building the tree does not reallocate
+	void reserve(size_t count)
+	{
+		m_children.reserve(count);
+		m_values.reserve(count);
 	}
 
-	bool setNode(NodeId id, Node node)
+	void clear()
 	{
-		if (!validateId(id))
-			return false;
-
-		m_nodes.at((size_t)id - 1) = node;
-
-		return true;
+		m_children.clear();
+		m_values.clear();
 	}
 
-public:
-
+	//Number of allocated nodes
+	size_t size() const { return m_children.size(); }
 
 	NodeId allocNode(const value_t& value)
 	{
-		m_nodes.push_back(Node(value));
-		return (NodeId)(m_nodes.size());
+		m_children.push_back(Children());
+		m_values.push_back(value);
+		return (NodeId)(m_children.size());
 	}
 
 	NodeId allocNode(value_t&& value)
 	{
-		m_nodes.push_back(Node(value));
-		return (NodeId)(m_nodes.size());
+		m_children.push_back(Children());
+		m_values.push_back(std::move(value));
+		return (NodeId)(m_children.size());
+	}
+
+	//Allocates a branch node already linked to its children, for building a tree from the leaves up in one pass
+	NodeId allocBranch(NodeId leftnodeid, NodeId rightnodeid, const value_t& value = value_t())
+	{
+		Children children;
+		children.node[0] = leftnodeid;
+		children.node[1] = rightnodeid;
+
+		m_children.push_back(children);
+		m_values.push_back(value);
+		return (NodeId)(m_children.size());
 	}
 
 	void linkNodeLeft(NodeId parentid, NodeId leftnodeid)
 	{
-		Node parent;
-		getNode(parentid, parent);
-		parent.left = leftnodeid;
-		setNode(parentid, parent);
+		if (validateId(parentid))
+			m_children[(size_t)parentid - 1].node[0] = leftnodeid;
 	}
 
 	void linkNodeRight(NodeId parentid, NodeId rightnodeid)
 	{
-		Node parent;
-		getNode(parentid, parent);
-		parent.right = rightnodeid;
-		setNode(parentid, parent);
+		if (validateId(parentid))
+			m_children[(size_t)parentid - 1].node[1] = rightnodeid;
 	}
 
 	void linkNode(NodeId parentid, NodeId childid, bool isright)
 	{
-		if (isright)
-			this->linkNodeRight(parentid, childid);
-		else
-			this->linkNodeLeft(parentid, childid);
+		if (validateId(parentid))
+			m_children[(size_t)parentid - 1].node[isright ? 1 : 0] = childid;
 	}
 
 	//Returns true if a node has no children
 	bool isNodeLeaf(NodeId node) const
 	{
-		Node n;
-
-		if (getNode(node, n))
-			return (!n.left && !n.right);
-		else
-			return false;
+		return validateId(node) && m_children[(size_t)node - 1].empty();
 	}
 
 	//Returns true if a node has at least one child
@@ -139,34 +127,39 @@ public:
 
 	NodeId getChildNodeLeft(NodeId id) const
 	{
-		Node n;
-		getNode(id, n);
-		return n.left;
+		return validateId(id) ? m_children[(size_t)id - 1].node[0] : 0;
 	}
 
 	NodeId getChildNodeRight(NodeId id) const
 	{
-		Node n;
-		getNode(id, n);
-		return n.right;
+		return validateId(id) ? m_children[(size_t)id - 1].node[1] : 0;
 	}
 
 	NodeId getChildNode(NodeId id, bool isright) const
 	{
-		if (isright)
-			return this->getChildNodeRight(id);
-		else
-			return this->getChildNodeLeft(id);
+		return validateId(id) ? m_children[(size_t)id - 1].node[isright ? 1 : 0] : 0;
 	}
 
 	bool getNodeValue(NodeId id, value_t& value) const
 	{
-		Node n;
-
-		if (!this->getNode(id, n))
+		if (!validateId(id))
 			return false;
 
-		value = n.value;
+		value = m_values[(size_t)id - 1];
 		return true;
 	}
+
+	//Unchecked accessors for walking the tree, the node must exist
+
+	const Children& children(NodeId id) const
+	{
+		assert(validateId(id));
+		return m_children[(size_t)id - 1];
+	}
+
+	const value_t& value(NodeId id) const
+	{
+		assert(validateId(id));
+		return m_values[(size_t)id - 1];
+	}
 };
@@ -1,165 +1,273 @@
 /*
- 	Bitstream class
+ 	Bitstream classes
  
- 	A class for manipulating streams of bits instead of streams of bytes,
+ 	Classes for manipulating streams of bits instead of streams of bytes,
  	bits are stored from left->right instead of right->left
+
+	BitWriter and BitReader move whole words between the buffer and a 64 bit accumulator
 */
 
 #pragma once
 
 #include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
 #include <vector>
-#include <ostream>
+#include <cassert>
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////
 
-template<typename T>
-struct bitSizeOf
-{
-	static const size_t value = (sizeof(T) * (size_t)CHAR_BIT);
-};
+/*
+	Buffered bit writer
 
-class BitStream
+	Bits are collected in a 64 bit accumulator, which is only stored to the buffer as a whole word when it is full.
+	Storing advances the write position by the number of complete bytes in the word.
+*/
+class BitWriter
 {
 public:
 
 	typedef unsigned char byte_t;
-	typedef bool bit_t;
-	typedef size_t bitpos_t;
 
-	//Width of a single byte, in bits
-	enum { bytewidth = CHAR_BIT };
-
-	BitStream() :
-		BitStream::BitStream(10 * bytewidth)
-	{}
+	//Maximum number of bits in a single write
+	enum { maxWriteBits = 57 };
 
 	//Reserve a certain number of bits
-	BitStream(size_t reservebits) :
-		m_bufferSize(0) //zero initialize the buffersize
+	BitWriter(size_t reservebits = 0)
 	{
-		m_buffer.resize(calcByteCount(reservebits));
+		m_buffer.resize((reservebits / CHAR_BIT) + sizeof(uint64_t) + 1);
 	}
 
-	BitStream(const byte_t* bytes, size_t numbits) :
-		BitStream::BitStream(numbits)
+	//Grows the buffer to hold at least reservebits bits, a buffer which is already large enough is kept as it is
+	void reserve(size_t reservebits)
 	{
-		m_bufferSize = numbits;
-		m_buffer = std::vector<byte_t>(bytes, bytes + calcByteCount(numbits));
+		const size_t size = (reservebits / CHAR_BIT) + sizeof(uint64_t) + 1;
+
+		if (size > m_buffer.size())
+			m_buffer.resize(size);
 	}
 
-	//Write part of a byte to the bitstream
-	template<typename type_t>
-	void write(type_t data, bitpos_t bitoffset = 0, bitpos_t bitcount = bitSizeOf<type_t>::value)
+	//Writes the low bitcount bits of data, the most significant of them first
+	void write(uint64_t data, uint32_t bitcount)
 	{
-		bitpos_t width = bitSizeOf<type_t>::value;
+		assert(bitcount <= maxWriteBits);
 
-		bitpos_t bitof = (bitoffset >= width) ? 0 : bitoffset;
-		bitpos_t bitsz = (bitcount > width) ? width : bitcount;
+		if (bitcount == 0)
+			return;
 
-		for (bitpos_t bit = bitof; bit < bitsz; bit++)
-		{
-			this->writebit((data & (type_t)(1 << (width - (bit + 1)))) != 0);
-		}
+		if ((m_accBits + bitcount) > 64)
+			flush();
+
+		m_acc |= (data & ((1ull << bitcount) - 1)) << (64 - m_accBits - bitcount);
+		m_accBits += bitcount;
 	}
 
-	//Read part of the bitstream to a byte
-	bool read(byte_t& data, bitpos_t bitpos = 0, bitpos_t bitcount = bitSizeOf<byte_t>::value)
+	void writebit(bool bit)
 	{
-		for (size_t i = bitpos; i < bitcount; i++)
-		{
-			bit_t bit = 0;
-			if (!readbit(bit))
-				return false;
-
-			data |= (bitpos_t(bit) << (bytewidth - (i + 1)));
-		}
-
-		return true;
+		write(bit ? 1 : 0, 1);
 	}
 
-	//Writes a single bit to the bitstream
-	void writebit(bit_t bit)
+	//Stores the accumulator to the buffer, leaving less than a byte of pending bits
+	//Must be called before the buffer is read
+	void flush()
 	{
-		//reallocate the bitstream if there is not enough space
-		if ((m_bufferWrite + 1) > (m_buffer.size() * bytewidth))
-			realloc();
+		//Make room for a whole word past the write position
+		if ((m_bytePos + sizeof(uint64_t)) > m_buffer.size())
+			m_buffer.resize(m_buffer.size() * 2);
 
-		bitpos_t& writeptr = m_bufferWrite;
+		//Work on a local copy, stores through byte pointers would otherwise force the member to be reloaded
+		const uint64_t acc = m_acc;
+		byte_t* out = &m_buffer[m_bytePos];
 
-		//Offset of the write pointer in bytes from the start of the buffer
-		const size_t index = writeptr / bytewidth;
-		//Offset of the write pointer in bits from the start of the nearest byte
-		const size_t offset = bytewidth - ((writeptr % bytewidth) + 1);
+		for (size_t i = 0; i < sizeof(uint64_t); i++)
+			out[i] = (byte_t)(acc >> (56 - (i * CHAR_BIT)));
 
-		m_buffer[index] |= ((size_t)bit * (1 << offset));
+		const uint32_t bytes = m_accBits / CHAR_BIT;
 
-		//Increment capacity and the write pointer
-		writeptr++;
-		m_bufferSize++;
+		m_bytePos += bytes;
+		m_acc = (bytes < sizeof(uint64_t)) ? (acc << (bytes * CHAR_BIT)) : 0;
+		m_accBits -= bytes * CHAR_BIT;
 	}
 
-	bool readbit(bit_t& bit)
+	//Pads the written bits with zero bits up to the next byte boundary
+	void align()
 	{
-		bitpos_t& readptr = m_bufferRead;
+		write(0, (CHAR_BIT - (m_accBits % CHAR_BIT)) % CHAR_BIT);
+	}
 
-		if (readptr >= (m_buffer.size() * bytewidth))
-			return false;
+	//Appends whole bytes, the written bits must end on a byte boundary
+	void writeBytes(const byte_t* data, size_t count)
+	{
+		assert((m_accBits % CHAR_BIT) == 0);
 
-		//Offset of the read pointer in bytes from the start of the buffer
-		const size_t index = readptr / bytewidth;
-		//Offset of the read pointer in bits from the start of the nearest byte
-		const size_t offset = bytewidth - ((readptr % bytewidth) + 1);
+		flush();
 
-		bit = (m_buffer[index] & (1 << offset)) != 0;
+		if ((m_bytePos + count + sizeof(uint64_t)) > m_buffer.size())
+			m_buffer.resize(std::max(m_buffer.size() * 2, m_bytePos + count + sizeof(uint64_t)));
 
-		readptr++;
+		if (count)
+			memcpy(&m_buffer[m_bytePos], data, count);
 
-		return true;
+		m_bytePos += count;
 	}
 
+	//Discards every bit written after the first bitcount bits, which must already have been written
+	void rewind(size_t bitcount)
+	{
+		assert(bitcount <= getBitCount());
+
+		//Pending bits are stored first, so the bits kept of a partial byte are in the buffer
+		flush();
+
+		m_bytePos = bitcount / CHAR_BIT;
+		m_accBits = bitcount % CHAR_BIT;
+		m_acc = m_accBits ? ((uint64_t)(m_buffer[m_bytePos] >> (CHAR_BIT - m_accBits)) << (64 - m_accBits)) : 0;
+	}
+
+	//Buffer holding the written bits, the last byte is padded with zero bits
 	const byte_t* getBitBuffer() const { return &m_buffer[0]; }
-	size_t getBitCount() const { return m_bufferSize; }
-	size_t getByteCount() const { return calcByteCount(m_bufferSize); }
+	size_t getBitCount() const { return (m_bytePos * CHAR_BIT) + m_accBits; }
+	size_t getByteCount() const { return (getBitCount() + CHAR_BIT - 1) / CHAR_BIT; }
 
-	void copyBitBuffer(std::ostream& stream) const
+	void clear()
 	{
-		stream.write((const char*)&m_buffer[0], getByteCount());
+		m_bytePos = 0;
+		m_acc = 0;
+		m_accBits = 0;
 	}
 
-	void clear()
+private:
+
+	std::vector<byte_t> m_buffer;
+	size_t m_bytePos = 0;	//Offset of the first byte not yet completed, in bytes from the start of the buffer
+	uint64_t m_acc = 0;		//Pending bits, starting from the most significant bit
+	uint32_t m_accBits = 0;	//Number of pending bits
+};
+
+/*
+	Buffered bit reader
+
+	Bits are read from a 64 bit window that is refilled a whole word at a time,
+	so any number of bits up to maxPeekBits can be inspected before they are consumed.
+*/
+class BitReader
+{
+public:
+
+	typedef unsigned char byte_t;
+
+	//Maximum number of bits that can be peeked at once
+	enum { maxPeekBits = 57 };
+
+	//Reader of an empty buffer
+	BitReader() :
+		m_buffer(nullptr),
+		m_bitCount(0),
+		m_byteCount(0)
+	{}
+
+	BitReader(const byte_t* buffer, size_t bitcount) :
+		m_buffer(buffer),
+		m_bitCount(bitcount),
+		m_byteCount((bitcount + CHAR_BIT - 1) / CHAR_BIT)
+	{}
+
+	//Returns the next bitcount bits without consuming them, the first bit is the most significant bit of the result
+	//Bits past the end of the buffer read as 0
+	uint64_t peek(uint32_t bitcount)
 	{
-		m_buffer.resize(1);
-		resetWrite();
-		resetRead();
+		assert(bitcount > 0 && bitcount <= maxPeekBits);
+
+		if (m_windowBits < bitcount)
+			refill();
+
+		return m_window >> (64 - bitcount);
 	}
 
-	//Get read/write pointers
-	bitpos_t getWrite() const { return m_bufferWrite; }
-	bitpos_t getRead() const { return m_bufferRead; }
+	//Consumes bits which have already been peeked
+	void consume(uint32_t bitcount)
+	{
+		assert(bitcount <= m_windowBits);
 
-private:
+		m_window <<= bitcount;
+		m_windowBits -= bitcount;
+	}
 
-	void resetWrite() { m_bufferWrite = 0; }
-	void resetRead() { m_bufferRead = 0; }
+	//Reads and consumes bitcount bits
+	uint64_t read(uint32_t bitcount)
+	{
+		const uint64_t bits = peek(bitcount);
+		consume(bitcount);
+		return bits;
+	}
 
-	size_t calcByteCount(size_t bitCount) const
+	bool readbit()
 	{
-		size_t bytecount = (bitCount / bytewidth);
-		if (bitCount % bytewidth)
-			bytecount++;
+		return read(1) != 0;
+	}
 
-		return bytecount;
+	//Moves the read position to a bit offset from the start of the buffer
+	void seek(size_t bitOffset)
+	{
+		m_bytePos = bitOffset / CHAR_BIT;
+		m_window = 0;
+		m_windowBits = 0;
+
+		if (bitOffset % CHAR_BIT)
+		{
+			refill();
+			consume(bitOffset % CHAR_BIT);
+		}
 	}
 
-	void realloc()
+	const byte_t* getBuffer() const { return m_buffer; }
+
+	//Number of bits consumed from the start of the buffer
+	size_t getRead() const { return (m_bytePos * CHAR_BIT) - m_windowBits; }
+	size_t getBitCount() const { return m_bitCount; }
+
+	//Returns true if more bits have been consumed than the buffer holds
+	bool overrun() const { return getRead() > m_bitCount; }
+
+private:
+
+	//Fills the window with at least maxPeekBits bits
+	void refill()
 	{
-		//Double the capacity
-		m_buffer.resize(m_buffer.size() * 2);
+		if ((m_bytePos + sizeof(uint64_t)) <= m_byteCount)
+		{
+			//Load a whole word and keep as many complete bytes of it as fit in the window
+			//Written out in full so compilers turn it into a single byte swapped load
+			const byte_t* in = m_buffer + m_bytePos;
+			const uint64_t word =
+				((uint64_t)in[0] << 56) | ((uint64_t)in[1] << 48) | ((uint64_t)in[2] << 40) | ((uint64_t)in[3] << 32) |
+				((uint64_t)in[4] << 24) | ((uint64_t)in[5] << 16) | ((uint64_t)in[6] << 8) | (uint64_t)in[7];
+
+			m_window |= word >> m_windowBits;
+			m_bytePos += (63 - m_windowBits) / CHAR_BIT;
+			m_windowBits |= 56;
+		}
+		else
+		{
+			//Near the end of the buffer, load single bytes and pad with zeroes
+			while (m_windowBits <= 56)
+			{
+				const uint64_t byte = (m_bytePos < m_byteCount) ? m_buffer[m_bytePos] : 0;
+
+				m_window |= byte << (56 - m_windowBits);
+				m_windowBits += CHAR_BIT;
+				m_bytePos++;
+			}
+		}
 	}
 
-	bitpos_t m_bufferWrite = 0;	//Write offset in bits, from the start of the buffer
-	bitpos_t m_bufferRead = 0;	//Read offset in bits, from the start of the buffer
-	bitpos_t m_bufferSize = 0; //Number of bits in the buffer, this does not necessarily equal m_buffer.size() * bytewidth
-	std::vector<byte_t> m_buffer;
+	const byte_t* m_buffer;
+	size_t m_bitCount;
+	size_t m_byteCount;
+	size_t m_bytePos = 0;		//Offset of the next byte to load into the window
+	uint64_t m_window = 0;		//Loaded bits, starting from the most significant bit
+	uint32_t m_windowBits = 0;	//Number of loaded bits
 };
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,264 @@
+/*
+	Batches
+*/
+
+#include "huffmanBatch.h"
+#include "huffmanHistogram.h"
+#include "huffmanError.h"
+#include "threadpool.h"
+
+#include <atomic>
+#include <climits>
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+typedef function<void(size_t chunk, size_t first, size_t last)> ChunkTask;
+
+//Number of contiguous chunks count records are split into, a few per thread to balance records of different sizes
+//Chunks are large enough that each one pays for its context once rather than once per record
+static size_t getChunkCount(unsigned int threadCount, size_t count)
+{
+	if (threadCount == 0)
+		threadCount = max(thread::hardware_concurrency(), 1u);
+
+	return min(count, (size_t)threadCount * 8);
+}
+
+//Calls task for each chunk of count records
+static void forEachChunk(ThreadPool& pool, size_t chunkCount, size_t count, const ChunkTask& task)
+{
+	pool.parallelFor(chunkCount, [&](size_t chunk) {
+		task(chunk, count * chunk / chunkCount, count * (chunk + 1) / chunkCount);
+	});
+}
+
+//Options of the context coding each chunk, the batch itself is spread across the threads
+static SHuffmanOptions chunkOptions(const SHuffmanOptions& options)
+{
+	SHuffmanOptions result = options;
+	result.threadCount = 1;
+	result.progress = nullptr;
+
+	return result;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool huffmanCompressBatch(const vector<SHuffmanSpan>& records, SHuffmanRecords& encodedRecords, const SHuffmanOptions& options, HuffmanDictionary* sharedTable)
+{
+	HuffmanErrorScope errors(options.error);
+
+	const size_t count = records.size();
+	const SHuffmanOptions recordOptions = chunkOptions(options);
+
+	encodedRecords.data.clear();
+	encodedRecords.offsets.assign(1, 0);
+
+	if (huffmanCompressBound(0, recordOptions) == 0)
+		return false;
+
+	ThreadPool pool(options.threadCount);
+	const size_t chunkCount = getChunkCount(options.threadCount, count);
+
+	if (sharedTable)
+	{
+		//Every chunk counts its own characters, the counts are added once every chunk has finished
+		vector<uint64_t> chunkCounts(chunkCount * HuffmanCodeTable::size);
+		uint64_t counts[HuffmanCodeTable::size] = {};
+
+		forEachChunk(pool, chunkCount, count, [&](size_t chunk, size_t first, size_t last) {
+			uint64_t* partCounts = &chunkCounts[chunk * HuffmanCodeTable::size];
+
+			for (size_t i = first; i < last; i++)
+				huffmanHistogramAdd(records[i].data, records[i].size, partCounts);
+		});
+
+		for (size_t chunk = 0; chunk < chunkCount; chunk++)
+		{
+			for (size_t ch = 0; ch < HuffmanCodeTable::size; ch++)
+				counts[ch] += chunkCounts[chunk * HuffmanCodeTable::size + ch];
+		}
+
+		if (!sharedTable->train(counts, options.maxCodeLength))
+			return false;
+	}
+
+	//Every record is encoded at an offset leaving room for its largest size, then the records are packed together
+	vector<size_t>& offsets = encodedRecords.offsets;
+	offsets.resize(count + 1);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (sharedTable && records[i].size > HUFFMAN_MAX_MESSAGE_SIZE)
+		{
+			HuffmanError() << "Records compressed with a shared table must be no larger than " << HUFFMAN_MAX_MESSAGE_SIZE << "B";
+			return false;
+		}
+
+		const size_t bound = sharedTable ? huffmanDictionaryCompressBound(records[i].size, *sharedTable) : huffmanCompressBound(records[i].size, recordOptions);
+		offsets[i + 1] = offsets[i] + bound;
+	}
+
+	encodedRecords.data.resize(offsets[count]);
+
+	vector<size_t> sizes(count);
+	atomic<bool> succeeded(true);
+
+	forEachChunk(pool, chunkCount, count, [&](size_t, size_t first, size_t last) {
+		HuffmanEncoder encoder(recordOptions);
+		uint8_t* data = encodedRecords.data.data();
+
+		for (size_t i = first; i < last && succeeded; i++)
+		{
+			const bool encoded = sharedTable ?
+				encoder.compress(records[i].data, records[i].size, *sharedTable, data + offsets[i], offsets[i + 1] - offsets[i], sizes[i]) :
+				encoder.compress(records[i].data, records[i].size, data + offsets[i], offsets[i + 1] - offsets[i], sizes[i]);
+
+			if (!encoded)
+				succeeded = false;
+		}
+	});
+
+	if (!succeeded)
+	{
+		encodedRecords.data.clear();
+		encodedRecords.offsets.assign(1, 0);
+		return false;
+	}
+
+	//Records only move towards the front, so each one is moved after the record before it has been
+	size_t position = 0;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (position != offsets[i])
+			memmove(encodedRecords.data.data() + position, encodedRecords.data.data() + offsets[i], sizes[i]);
+
+		offsets[i] = position;
+		position += sizes[i];
+	}
+
+	offsets[count] = position;
+	encodedRecords.data.resize(position);
+
+	return true;
+}
+
+bool huffmanDecompressBatch(const SHuffmanRecords& encodedRecords, SHuffmanRecords& records, const SHuffmanOptions& options, const HuffmanDictionary* sharedTable)
+{
+	HuffmanErrorScope errors(options.error);
+
+	const size_t count = encodedRecords.count();
+	const SHuffmanOptions recordOptions = chunkOptions(options);
+
+	records.data.clear();
+	records.offsets.assign(1, 0);
+
+	if (sharedTable && !sharedTable->isValid())
+	{
+		HuffmanError() << "Shared table has not been trained or loaded";
+		return false;
+	}
+
+	ThreadPool pool(options.threadCount);
+	const size_t chunkCount = getChunkCount(options.threadCount, count);
+
+	//The size of every decoded record is read from its header or block index, so the records are decoded straight into place
+	//Sizes are checked before anything is allocated for them, as they are read from records which may not be trusted
+	vector<size_t>& offsets = records.offsets;
+	offsets.resize(count + 1);
+
+	atomic<bool> succeeded(true);
+
+	forEachChunk(pool, chunkCount, count, [&](size_t, size_t first, size_t last) {
+		HuffmanDecoder decoder(recordOptions);
+
+		for (size_t i = first; i < last && succeeded; i++)
+		{
+			const SHuffmanSpan record = encodedRecords[i];
+			uint32_t dictionaryId = 0;
+			size_t messageSize = 0;
+			uint64_t textSize = 0;
+			bool valid = false;
+
+			if (sharedTable)
+			{
+				//Every code is at least 1 bit long, so a message holds no more characters than it has bits after its header
+				valid = huffmanMessageInfo(record.data, record.size, dictionaryId, messageSize) &&
+					dictionaryId == sharedTable->getId() && messageSize <= HUFFMAN_MAX_MESSAGE_SIZE &&
+					messageSize / CHAR_BIT <= record.size - sizeof(SHuffmanMessageHeader);
+
+				offsets[i + 1] = messageSize;
+			}
+			else
+			{
+				//The block index has already been checked against the length of the record, no block is larger than the
+				//block size of the stream and every block takes a header and an index entry
+				valid = decoder.decompressedSize(record.data, record.size, textSize) && textSize <= SIZE_MAX;
+
+				offsets[i + 1] = (size_t)textSize;
+			}
+
+			if (!valid)
+			{
+				HuffmanError() << "Record " << i << " is not a valid encoded record";
+				succeeded = false;
+			}
+		}
+	});
+
+	if (!succeeded)
+	{
+		records.offsets.assign(1, 0);
+		return false;
+	}
+
+	offsets[0] = 0;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (offsets[i + 1] > records.data.max_size() - offsets[i])
+		{
+			HuffmanError() << "Decoded records do not fit in memory";
+			records.offsets.assign(1, 0);
+			return false;
+		}
+
+		offsets[i + 1] += offsets[i];
+	}
+
+	records.data.resize(offsets[count]);
+
+	forEachChunk(pool, chunkCount, count, [&](size_t, size_t first, size_t last) {
+		HuffmanDecoder decoder(recordOptions);
+		uint8_t* data = records.data.data();
+
+		for (size_t i = first; i < last && succeeded; i++)
+		{
+			const SHuffmanSpan record = encodedRecords[i];
+			size_t textSize = 0;
+
+			const bool decoded = sharedTable ?
+				huffmanDecompressWithDictionary(record.data, record.size, *sharedTable, data + offsets[i], offsets[i + 1] - offsets[i], textSize) :
+				decoder.decompress(record.data, record.size, data + offsets[i], offsets[i + 1] - offsets[i], textSize);
+
+			if (!decoded || textSize != offsets[i + 1] - offsets[i])
+				succeeded = false;
+		}
+	});
+
+	if (!succeeded)
+	{
+		records.data.clear();
+		records.offsets.assign(1, 0);
+		return false;
+	}
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
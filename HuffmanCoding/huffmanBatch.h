@@ -0,0 +1,69 @@
+/*
+	Batches
+
+	Compress and decompress many independent records in one call, spread across a thread pool. Records are packed one
+	after another into a single buffer with an array of offsets, so a batch of thousands of records makes only a few
+	allocations, and each thread codes its share of the records with its own encoder or decoder context.
+*/
+
+#pragma once
+
+#include "huffmanEncoder.h"
+#include "huffmanDictionary.h"
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//A record of text or encoded text held in memory owned by the caller
+struct SHuffmanSpan
+{
+	const uint8_t* data = nullptr;
+	size_t size = 0;
+};
+
+//Records packed one after another into a single buffer
+struct SHuffmanRecords
+{
+	std::vector<uint8_t> data;
+	std::vector<size_t> offsets;	//Offset of each record in data followed by the size of data, record i is [offsets[i], offsets[i + 1])
+
+	size_t count() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+
+	SHuffmanSpan operator[](size_t i) const
+	{
+		SHuffmanSpan span;
+		span.data = data.data() + offsets[i];
+		span.size = offsets[i + 1] - offsets[i];
+		return span;
+	}
+};
+
+/*
+	Compresses every record on options.threadCount threads, encodedRecords holds the encoded records in the same order
+
+	Without a shared table every record is a block stream which huffmanDecompressBuffer can also decompress.
+	With one, a dictionary is trained on the characters of the whole batch and stored in sharedTable, and every record
+	is a message referencing it, so no record holds a code table of its own. The same dictionary must be passed to
+	huffmanDecompressBatch, or to huffmanDecompressWithDictionary to decompress a single record.
+
+	No progress is reported and options.progress is ignored.
+*/
+bool huffmanCompressBatch(
+	const std::vector<SHuffmanSpan>& records,
+	SHuffmanRecords& encodedRecords,
+	const SHuffmanOptions& options = SHuffmanOptions(),
+	HuffmanDictionary* sharedTable = nullptr
+);
+
+//Decompresses every record of a batch on options.threadCount threads, sharedTable must be the table the batch was compressed with, if any
+bool huffmanDecompressBatch(
+	const SHuffmanRecords& encodedRecords,
+	SHuffmanRecords& records,
+	const SHuffmanOptions& options = SHuffmanOptions(),
+	const HuffmanDictionary* sharedTable = nullptr
+);
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,855 @@
+/*
+	Block format
+*/
+
+#include "huffmanBlock.h"
+#include "huffmanEncoder.h"
+#include "huffmanHistogram.h"
+#include "huffmanError.h"
+
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+using namespace std::chrono;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//Seconds since a point in time, for block statistics
+static double secondsSince(steady_clock::time_point start)
+{
+	return duration<double>(steady_clock::now() - start).count();
+}
+
+//Finds the payload size and longest code of a block from its character counts
+static void fillCodeStats(const HuffmanCodeTable& table, SHuffmanBlockStats& stats)
+{
+	stats.payloadBits = 0;
+	stats.maxCodeLength = 0;
+
+	for (uint32_t ch = 0; ch < HuffmanCodeTable::size; ch++)
+	{
+		if (stats.counts[ch] == 0)
+			continue;
+
+		stats.payloadBits += (uint64_t)stats.counts[ch] * table[(uint8_t)ch].length;
+		stats.maxCodeLength = max(stats.maxCodeLength, table[(uint8_t)ch].length);
+	}
+}
+
+bool huffmanEncodeCharacters(const HuffmanCodeTable& table, const uint8_t* text, size_t textSize, BitWriter& stream)
+{
+	size_t i = 0;
+
+	//Codes of up to 14 bits are written 4 at a time, so the writer checks for a full accumulator once per 4 characters
+	static_assert(4 * HUFFMAN_FAST_CODE_LENGTH <= BitWriter::maxWriteBits, "4 codes must fit in a single write");
+
+	if (table.getMaxLength() <= HUFFMAN_FAST_CODE_LENGTH)
+	{
+		for (; (i + 4) <= textSize; i += 4)
+		{
+			const SHuffmanCode& c0 = table[text[i]];
+			const SHuffmanCode& c1 = table[text[i + 1]];
+			const SHuffmanCode& c2 = table[text[i + 2]];
+			const SHuffmanCode& c3 = table[text[i + 3]];
+
+			//A length of 0 wraps around, so characters without a code are found with a single compare and reported below
+			if (((c0.length - 1) | (c1.length - 1) | (c2.length - 1) | (c3.length - 1)) >= 16)
+				break;
+
+			uint64_t bits = c0.pattern;
+			bits = (bits << c1.length) | c1.pattern;
+			bits = (bits << c2.length) | c2.pattern;
+			bits = (bits << c3.length) | c3.pattern;
+
+			stream.write(bits, c0.length + c1.length + c2.length + c3.length);
+		}
+	}
+
+	for (; i < textSize; i++)
+	{
+		const SHuffmanCode& code = table[text[i]];
+
+		if (code.length == 0)
+		{
+			HuffmanError() << "No pattern could be found for char '" << (char)text[i] << "'";
+			return false;
+		}
+
+		stream.write(code.pattern, code.length);
+	}
+
+	stream.flush();
+
+	return true;
+}
+
+//Encodes character i of a block to substream (i % streamCount), then writes the jump table and substreams to stream
+static bool encodeInterleavedStreams(const HuffmanCodeTable& table, const uint8_t* text, size_t textSize, unsigned int streamCount, BitWriter* substreams, BitWriter& stream)
+{
+	for (unsigned int i = 0; i < streamCount; i++)
+	{
+		substreams[i].clear();
+		substreams[i].reserve(huffmanBlockBound(textSize / streamCount + 1, 1, table.getMaxLength()) * CHAR_BIT);
+	}
+
+	unsigned int next = 0;
+
+	for (size_t i = 0; i < textSize; i++)
+	{
+		const SHuffmanCode& code = table[text[i]];
+
+		if (code.length == 0)
+		{
+			HuffmanError() << "No pattern could be found for char '" << (char)text[i] << "'";
+			return false;
+		}
+
+		substreams[next].write(code.pattern, code.length);
+
+		if (++next == streamCount)
+			next = 0;
+	}
+
+	//Jump table locating each bitstream
+	for (unsigned int i = 0; (i + 1) < streamCount; i++)
+		stream.write(substreams[i].getByteCount(), 32);
+
+	stream.align();
+
+	for (unsigned int i = 0; i < streamCount; i++)
+	{
+		substreams[i].flush();
+		stream.writeBytes(substreams[i].getBitBuffer(), substreams[i].getByteCount());
+	}
+
+	stream.flush();
+
+	return true;
+}
+
+//Writes the tag of a block which is not coded, the characters start at the next byte
+static void writeBlockType(EHuffmanBlockType type, BitWriter& stream)
+{
+	stream.write(0, 3);
+	stream.write(type, 2);
+	stream.align();
+}
+
+//Writes a raw or run block, run blocks hold a single distinct character
+static void encodeUncodedBlock(EHuffmanBlockType type, const uint8_t* text, size_t textSize, BitWriter& stream, size_t checkpointInterval, uint32_t* checkpoints)
+{
+	writeBlockType(type, stream);
+
+	const size_t start = stream.getBitCount();
+
+	for (size_t k = 0; k * checkpointInterval < textSize && checkpointInterval; k++)
+		checkpoints[k] = (uint32_t)((type == HUFFMAN_BLOCK_RAW) ? (start + k * checkpointInterval * CHAR_BIT) : start);
+
+	if (type == HUFFMAN_BLOCK_RAW)
+		stream.writeBytes(text, textSize);
+	else
+		stream.write(text[0], 8);
+
+	stream.flush();
+}
+
+//Reads the type of a block, the read position is left at the code table of coded blocks or the characters of others
+static bool readBlockType(BitReader& stream, EHuffmanBlockType& type)
+{
+	if (stream.peek(3) != 0)
+	{
+		type = HUFFMAN_BLOCK_CODED;
+		return true;
+	}
+
+	stream.read(3);
+	type = (EHuffmanBlockType)stream.read(2);
+
+	if (type != HUFFMAN_BLOCK_RAW && type != HUFFMAN_BLOCK_RUN && type != HUFFMAN_BLOCK_SPLIT)
+	{
+		HuffmanError() << "Unknown block type " << type;
+		return false;
+	}
+
+	//Characters start at the next byte
+	stream.seek((stream.getRead() + CHAR_BIT - 1) / CHAR_BIT * CHAR_BIT);
+
+	return true;
+}
+
+//Decodes textSize characters of a raw or run block starting from the bit offset of a character in a raw block,
+//or of the character of a run block
+static bool decodeUncodedBlock(EHuffmanBlockType type, BitReader& stream, size_t bitOffset, uint8_t* text, size_t textSize)
+{
+	const size_t bytes = (type == HUFFMAN_BLOCK_RAW) ? textSize : 1;
+
+	if (bitOffset < stream.getRead() || bitOffset % CHAR_BIT || bitOffset / CHAR_BIT + bytes > stream.getBitCount() / CHAR_BIT)
+	{
+		HuffmanError() << "Block is truncated";
+		return false;
+	}
+
+	const uint8_t* characters = stream.getBuffer() + bitOffset / CHAR_BIT;
+
+	if (type == HUFFMAN_BLOCK_RAW)
+		memcpy(text, characters, textSize);
+	else
+		memset(text, characters[0], textSize);
+
+	stream.seek(bitOffset + bytes * CHAR_BIT);
+
+	return true;
+}
+
+//Characters in each chunk of text counted by a sampled histogram
+static const size_t sampleChunkSize = 1024;
+
+//Counts the characters of one chunk out of every sampleStep chunks of text, returns the number of characters counted
+static size_t sampledHistogram(const uint8_t* text, size_t textSize, size_t sampleStep, uint32_t counts[HuffmanCodeTable::size])
+{
+	uint64_t totals[HuffmanCodeTable::size] = {};
+	size_t sampled = 0;
+
+	for (size_t position = 0; position < textSize; position += sampleChunkSize * sampleStep)
+	{
+		const size_t size = min(sampleChunkSize, textSize - position);
+		huffmanHistogramAdd(text + position, size, totals);
+		sampled += size;
+	}
+
+	//Blocks are small enough for their counts to fit in 32 bits
+	for (size_t ch = 0; ch < HuffmanCodeTable::size; ch++)
+		counts[ch] = (uint32_t)totals[ch];
+
+	return sampled;
+}
+
+//Encodes a block as a single coded, raw or run block, levels below HUFFMAN_DEFAULT_LEVEL build the code table from a sample
+static bool encodeBlock(const uint8_t* text, size_t textSize, uint32_t maxCodeLength, unsigned int streamCount, BitWriter& stream, SHuffmanBlockStats* stats, SHuffmanBlockScratch* scratch,
+	size_t checkpointInterval, uint32_t* checkpoints, unsigned int level)
+{
+	steady_clock::time_point start;
+
+	if (stats)
+		start = steady_clock::now();
+
+	//Frequency of each character in the text
+	uint32_t localCounts[HuffmanCodeTable::size];
+	uint32_t* counts = stats ? stats->counts : localCounts;
+	size_t counted = textSize;
+
+	//Fast levels count a sample of the text, and give characters missing from it a count of 1 so every character has
+	//a code and the text is read only once to encode it. Samples of a single character may be a run block, so they
+	//are counted exactly, as are blocks whose codes cannot be short enough to give every character one.
+	const size_t sampleStep = (level <= HUFFMAN_MIN_LEVEL) ? 16 : 4;
+	uint32_t sampleCounts[HuffmanCodeTable::size];
+	bool sampled = false;
+
+	if (level < HUFFMAN_DEFAULT_LEVEL && maxCodeLength >= CHAR_BIT && textSize > sampleChunkSize * sampleStep)
+	{
+		counted = sampledHistogram(text, textSize, sampleStep, sampleCounts);
+		sampled = count_if(sampleCounts, sampleCounts + HuffmanCodeTable::size, [](uint32_t count) { return count != 0; }) > 1;
+	}
+
+	if (sampled)
+	{
+		for (uint32_t& count : sampleCounts)
+			count = max(count, 1u);
+
+		counts = sampleCounts;
+
+		//Statistics need the counts of the whole text
+		if (stats)
+			huffmanHistogram(text, textSize, stats->counts);
+	}
+	else
+	{
+		counted = textSize;
+		huffmanHistogram(text, textSize, counts);
+	}
+
+	if (stats)
+	{
+		stats->histogramTime = secondsSince(start);
+		start = steady_clock::now();
+	}
+
+	const size_t distinct = (size_t)count_if(counts, counts + HuffmanCodeTable::size, [](uint32_t count) { return count != 0; });
+
+	//Blocks of one character are a single run, which needs no code table
+	if (distinct == 1)
+	{
+		encodeUncodedBlock(HUFFMAN_BLOCK_RUN, text, textSize, stream, checkpointInterval, checkpoints);
+
+		if (stats)
+		{
+			stats->codingTime = secondsSince(start);
+			stats->payloadBits = 0;
+			stats->maxCodeLength = 0;
+		}
+
+		return true;
+	}
+
+	HuffmanCodeTable table;
+
+	//Sampled tables are built for speed, with codes short enough to be written several at a time
+	if (!huffmanBuildCodeTable(counts, table, sampled ? min(maxCodeLength, HUFFMAN_FAST_CODE_LENGTH) : maxCodeLength))
+		return false;
+
+	//Size of the coded block from its histogram, interleaved bitstreams add a jump table and padding
+	uint64_t codedBits = table.getSerializedBits() + ((streamCount > 1) ? (streamCount * (32 + CHAR_BIT)) : 0);
+
+	uint64_t payloadBits = 0;
+
+	for (uint32_t ch = 0; ch < HuffmanCodeTable::size; ch++)
+		payloadBits += (uint64_t)counts[ch] * table[(uint8_t)ch].length;
+
+	//Payload of a sample is scaled up to the whole text
+	codedBits += (counted == textSize) ? payloadBits : (uint64_t)((double)payloadBits * textSize / counted);
+
+	//Blocks which coding would not shrink are stored as they are
+	const uint64_t rawBits = (uint64_t)(textSize + 1) * CHAR_BIT;
+
+	auto encodeRaw = [&]()
+	{
+		encodeUncodedBlock(HUFFMAN_BLOCK_RAW, text, textSize, stream, checkpointInterval, checkpoints);
+
+		if (stats)
+		{
+			stats->codingTime = secondsSince(start);
+			stats->payloadBits = (uint64_t)textSize * CHAR_BIT;
+			stats->maxCodeLength = CHAR_BIT;
+		}
+	};
+
+	if (codedBits >= rawBits)
+	{
+		if (stats)
+		{
+			stats->tableTime = secondsSince(start);
+			start = steady_clock::now();
+		}
+
+		encodeRaw();
+		return true;
+	}
+
+	const size_t blockStart = stream.getBitCount();
+
+	table.serialize(stream);
+
+	if (stats)
+	{
+		stats->tableTime = secondsSince(start);
+		start = steady_clock::now();
+	}
+
+	//Single bitstreams are encoded in place after the code table
+	bool encoded = false;
+
+	if (checkpointInterval)
+	{
+		//Characters are encoded a checkpoint at a time, recording where the code of the first one starts
+		encoded = true;
+
+		for (size_t position = 0, k = 0; position < textSize && encoded; position += checkpointInterval, k++)
+		{
+			checkpoints[k] = (uint32_t)stream.getBitCount();
+			encoded = huffmanEncodeCharacters(table, text + position, min(checkpointInterval, textSize - position), stream);
+		}
+	}
+	else if (streamCount == 1)
+	{
+		encoded = huffmanEncodeCharacters(table, text, textSize, stream);
+	}
+	else if (scratch)
+	{
+		encoded = encodeInterleavedStreams(table, text, textSize, streamCount, scratch->substreams, stream);
+	}
+	else
+	{
+		vector<BitWriter> substreams(streamCount);
+		encoded = encodeInterleavedStreams(table, text, textSize, streamCount, substreams.data(), stream);
+	}
+
+	//The size from a sample is only an estimate, a block it misjudged is stored raw so it stays within huffmanBlockBound
+	if (encoded && sampled && (stream.getBitCount() - blockStart) >= rawBits)
+	{
+		stream.rewind(blockStart);
+		encodeRaw();
+		return true;
+	}
+
+	if (stats)
+	{
+		stats->codingTime = secondsSince(start);
+		fillCodeStats(table, *stats);
+	}
+
+	return encoded;
+}
+
+//Size of the header of a split block of some number of parts, after its block type
+static size_t splitHeaderBytes(unsigned int parts)
+{
+	return 1 + parts * 2 * sizeof(uint32_t);
+}
+
+//Encodes a block as a whole and split into 2, and at the highest level 4, parts of equal size each with its own code
+//table, then writes whichever is smallest
+static bool encodeSplitBlock(const uint8_t* text, size_t textSize, uint32_t maxCodeLength, unsigned int streamCount, BitWriter& stream, SHuffmanBlockStats* stats, SHuffmanBlockScratch* scratch,
+	unsigned int level)
+{
+	//Candidates of 1, 2 and 4 parts take writers [0], [1, 2] and [3, 6]
+	vector<BitWriter> localWriters(scratch ? 0 : HUFFMAN_SPLIT_WRITER_COUNT);
+	BitWriter* writers = scratch ? scratch->splitParts : localWriters.data();
+
+	//Statistics of every candidate part, kept on the stack so a block with scratch memory allocates nothing
+	SHuffmanBlockStats partStats[HUFFMAN_SPLIT_WRITER_COUNT];
+
+	const unsigned int maxParts = (level >= HUFFMAN_MAX_LEVEL) ? HUFFMAN_MAX_SPLIT_PARTS : 2;
+	unsigned int bestParts = 1;
+	size_t bestBytes = SIZE_MAX;
+
+	for (unsigned int parts = 1; parts <= maxParts && textSize >= parts; parts *= 2)
+	{
+		size_t bytes = (parts > 1) ? (1 + splitHeaderBytes(parts)) : 0;
+
+		for (unsigned int i = 0; i < parts; i++)
+		{
+			const size_t first = textSize * i / parts;
+			const size_t last = textSize * (i + 1) / parts;
+			BitWriter& writer = writers[parts - 1 + i];
+
+			writer.clear();
+
+			if (!encodeBlock(text + first, last - first, maxCodeLength, streamCount, writer, stats ? &partStats[parts - 1 + i] : nullptr, scratch, 0, nullptr, HUFFMAN_DEFAULT_LEVEL))
+				return false;
+
+			bytes += writer.getByteCount();
+		}
+
+		if (bytes < bestBytes)
+		{
+			bestBytes = bytes;
+			bestParts = parts;
+		}
+	}
+
+	if (bestParts == 1)
+	{
+		stream.writeBytes(writers[0].getBitBuffer(), writers[0].getByteCount());
+	}
+	else
+	{
+		writeBlockType(HUFFMAN_BLOCK_SPLIT, stream);
+		stream.write(bestParts, 8);
+
+		for (unsigned int i = 0; i < bestParts; i++)
+		{
+			stream.write((uint32_t)(textSize * (i + 1) / bestParts - textSize * i / bestParts), 32);
+			stream.write((uint32_t)writers[bestParts - 1 + i].getBitCount(), 32);
+		}
+
+		for (unsigned int i = 0; i < bestParts; i++)
+			stream.writeBytes(writers[bestParts - 1 + i].getBitBuffer(), writers[bestParts - 1 + i].getByteCount());
+	}
+
+	stream.flush();
+
+	if (stats)
+	{
+		//Counts of the whole block are the counts of its parts
+		const SHuffmanBlockStats* best = &partStats[bestParts - 1];
+
+		memset(stats->counts, 0, sizeof(stats->counts));
+		stats->payloadBits = 0;
+		stats->maxCodeLength = 0;
+		stats->histogramTime = stats->tableTime = stats->codingTime = 0;
+
+		for (const SHuffmanBlockStats& part : partStats)
+		{
+			stats->histogramTime += part.histogramTime;
+			stats->tableTime += part.tableTime;
+			stats->codingTime += part.codingTime;
+		}
+
+		for (unsigned int i = 0; i < bestParts; i++)
+		{
+			for (size_t ch = 0; ch < HuffmanCodeTable::size; ch++)
+				stats->counts[ch] += best[i].counts[ch];
+
+			stats->payloadBits += best[i].payloadBits;
+			stats->maxCodeLength = max(stats->maxCodeLength, best[i].maxCodeLength);
+		}
+	}
+
+	return true;
+}
+
+bool huffmanEncodeBlock(const uint8_t* text, size_t textSize, uint32_t maxCodeLength, unsigned int streamCount, BitWriter& stream, SHuffmanBlockStats* stats, SHuffmanBlockScratch* scratch,
+	size_t checkpointInterval, uint32_t* checkpoints, unsigned int level)
+{
+	//Blocks hold at least one character, split blocks would otherwise copy whatever their writers last held
+	if (textSize == 0 || streamCount == 0 || streamCount > HUFFMAN_MAX_STREAM_COUNT || (checkpointInterval && streamCount != 1) ||
+		level < HUFFMAN_MIN_LEVEL || level > HUFFMAN_MAX_LEVEL)
+		return false;
+
+	//Checkpoints are decoded with the code table at the start of their block, so blocks with checkpoints are never split
+	if (level > HUFFMAN_DEFAULT_LEVEL && !checkpointInterval)
+		return encodeSplitBlock(text, textSize, maxCodeLength, streamCount, stream, stats, scratch, level);
+
+	return encodeBlock(text, textSize, maxCodeLength, streamCount, stream, stats, scratch, checkpointInterval, checkpoints, level);
+}
+
+bool huffmanDecodeCharacters(const HuffmanDecodeTable& decodeTable, BitReader& stream, uint8_t* text, size_t textSize)
+{
+	for (size_t i = 0; i < textSize; i++)
+	{
+		if (!decodeTable.decode(stream, text[i]))
+		{
+			HuffmanError() << "Invalid code at bit " << stream.getRead();
+			return false;
+		}
+	}
+
+	//Every character must have been decoded from within the bitstream
+	if (stream.overrun())
+	{
+		HuffmanError() << "Bitstream is truncated";
+		return false;
+	}
+
+	return true;
+}
+
+//Decodes one character from each of streamCount bitstreams per pass
+//Each decode does not depend on the others, so their table lookups overlap instead of waiting on the code length of
+//the previous character. Readers are copied to locals so their state stays in registers.
+template<unsigned int streamCount>
+static bool decodePasses(const HuffmanDecodeTable& decodeTable, BitReader* substreams, uint8_t* out, size_t passes)
+{
+	BitReader readers[streamCount];
+	bool valid = true;
+
+	for (unsigned int i = 0; i < streamCount; i++)
+		readers[i] = substreams[i];
+
+	for (size_t pass = 0; pass < passes; pass++)
+	{
+		for (unsigned int i = 0; i < streamCount; i++)
+			valid &= decodeTable.decode(readers[i], out[i]);
+
+		out += streamCount;
+	}
+
+	for (unsigned int i = 0; i < streamCount; i++)
+		substreams[i] = readers[i];
+
+	return valid;
+}
+
+//Decodes the characters of a block from several interleaved bitstreams
+static bool decodeInterleavedStreams(const HuffmanDecodeTable& decodeTable, BitReader& stream, uint8_t* text, size_t textSize, unsigned int streamCount)
+{
+	size_t sizes[HUFFMAN_MAX_STREAM_COUNT] = {};
+
+	for (unsigned int i = 0; (i + 1) < streamCount; i++)
+		sizes[i] = (size_t)stream.read(32);
+
+	//Bitstreams start at the next byte boundary
+	size_t offset = (stream.getRead() + CHAR_BIT - 1) / CHAR_BIT;
+	const size_t byteCount = stream.getBitCount() / CHAR_BIT;
+
+	if (offset > byteCount)
+	{
+		HuffmanError() << "Block is truncated";
+		return false;
+	}
+
+	BitReader substreams[HUFFMAN_MAX_STREAM_COUNT];
+
+	for (unsigned int i = 0; i < streamCount; i++)
+	{
+		//Last bitstream takes the rest of the block
+		const size_t size = ((i + 1) < streamCount) ? sizes[i] : (byteCount - offset);
+
+		if (size > (byteCount - offset))
+		{
+			HuffmanError() << "Invalid bitstream size";
+			return false;
+		}
+
+		substreams[i] = BitReader(stream.getBuffer() + offset, size * CHAR_BIT);
+		offset += size;
+	}
+
+	const size_t passes = textSize / streamCount;
+	uint8_t* out = text;
+	bool valid = true;
+
+	switch (streamCount)
+	{
+	case 2: valid = decodePasses<2>(decodeTable, substreams, out, passes); break;
+	case 4: valid = decodePasses<4>(decodeTable, substreams, out, passes); break;
+	case 8: valid = decodePasses<8>(decodeTable, substreams, out, passes); break;
+	default:
+		for (size_t pass = 0; pass < passes; pass++)
+		{
+			for (unsigned int i = 0; i < streamCount; i++)
+				valid &= decodeTable.decode(substreams[i], out[i]);
+
+			out += streamCount;
+		}
+	}
+
+	out = text + (passes * streamCount);
+
+	for (unsigned int i = 0; i < (textSize % streamCount); i++)
+		valid &= decodeTable.decode(substreams[i], out[i]);
+
+	if (!valid)
+	{
+		HuffmanError() << "Invalid code in block";
+		return false;
+	}
+
+	for (unsigned int i = 0; i < streamCount; i++)
+	{
+		if (substreams[i].overrun())
+		{
+			HuffmanError() << "Block is truncated";
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool decodeBlock(BitReader& stream, uint8_t* text, size_t textSize, unsigned int streamCount, SHuffmanBlockStats* stats, SHuffmanBlockScratch* scratch, bool allowSplit);
+
+//Decodes the parts of a split block, each part is decoded as a block of its own
+static bool decodeSplitBlock(BitReader& stream, uint8_t* text, size_t textSize, unsigned int streamCount, SHuffmanBlockStats* stats, SHuffmanBlockScratch* scratch)
+{
+	const unsigned int parts = (unsigned int)stream.read(8);
+
+	if (parts < 2 || parts > HUFFMAN_MAX_SPLIT_PARTS)
+	{
+		HuffmanError() << "Invalid number of parts " << parts << " in split block";
+		return false;
+	}
+
+	size_t sizes[HUFFMAN_MAX_SPLIT_PARTS] = {};
+	size_t bitcounts[HUFFMAN_MAX_SPLIT_PARTS] = {};
+	size_t total = 0;
+
+	for (unsigned int i = 0; i < parts; i++)
+	{
+		sizes[i] = (size_t)stream.read(32);
+		bitcounts[i] = (size_t)stream.read(32);
+		total += sizes[i];
+	}
+
+	if (total != textSize)
+	{
+		HuffmanError() << "Parts of split block do not hold " << textSize << " characters";
+		return false;
+	}
+
+	//Parts start at the next byte boundary
+	size_t offset = (stream.getRead() + CHAR_BIT - 1) / CHAR_BIT;
+	const size_t byteCount = stream.getBitCount() / CHAR_BIT;
+
+	SHuffmanBlockStats partStats;
+
+	for (unsigned int i = 0; i < parts; i++)
+	{
+		const size_t partBytes = (bitcounts[i] + CHAR_BIT - 1) / CHAR_BIT;
+
+		if (offset > byteCount || partBytes > byteCount - offset)
+		{
+			HuffmanError() << "Block is truncated";
+			return false;
+		}
+
+		BitReader part(stream.getBuffer() + offset, bitcounts[i]);
+
+		if (!decodeBlock(part, text, sizes[i], streamCount, stats ? &partStats : nullptr, scratch, false))
+			return false;
+
+		if (stats)
+		{
+			for (size_t ch = 0; ch < HuffmanCodeTable::size; ch++)
+				stats->counts[ch] += partStats.counts[ch];
+
+			stats->payloadBits += partStats.payloadBits;
+			stats->maxCodeLength = max(stats->maxCodeLength, partStats.maxCodeLength);
+			stats->histogramTime += partStats.histogramTime;
+			stats->tableTime += partStats.tableTime;
+			stats->codingTime += partStats.codingTime;
+		}
+
+		text += sizes[i];
+		offset += partBytes;
+	}
+
+	return true;
+}
+
+bool huffmanDecodeBlock(BitReader& stream, uint8_t* text, size_t textSize, unsigned int streamCount, SHuffmanBlockStats* stats, SHuffmanBlockScratch* scratch)
+{
+	return decodeBlock(stream, text, textSize, streamCount, stats, scratch, true);
+}
+
+//Decodes a block of any type, parts of split blocks cannot be split themselves
+static bool decodeBlock(BitReader& stream, uint8_t* text, size_t textSize, unsigned int streamCount, SHuffmanBlockStats* stats, SHuffmanBlockScratch* scratch, bool allowSplit)
+{
+	if (streamCount == 0 || streamCount > HUFFMAN_MAX_STREAM_COUNT)
+		return false;
+
+	steady_clock::time_point start;
+
+	if (stats)
+		start = steady_clock::now();
+
+	EHuffmanBlockType type = HUFFMAN_BLOCK_CODED;
+
+	if (!readBlockType(stream, type))
+		return false;
+
+	if (type == HUFFMAN_BLOCK_SPLIT)
+	{
+		if (!allowSplit)
+		{
+			HuffmanError() << "Split block holds a split block";
+			return false;
+		}
+
+		if (stats)
+			*stats = SHuffmanBlockStats();
+
+		return decodeSplitBlock(stream, text, textSize, streamCount, stats, scratch);
+	}
+
+	if (type != HUFFMAN_BLOCK_CODED)
+	{
+		if (!decodeUncodedBlock(type, stream, stream.getRead(), text, textSize))
+			return false;
+
+		if (stats)
+		{
+			stats->codingTime = secondsSince(start);
+			start = steady_clock::now();
+
+			huffmanHistogram(text, textSize, stats->counts);
+
+			stats->payloadBits = (type == HUFFMAN_BLOCK_RAW) ? (uint64_t)textSize * CHAR_BIT : 0;
+			stats->maxCodeLength = (type == HUFFMAN_BLOCK_RAW) ? CHAR_BIT : 0;
+			stats->histogramTime = secondsSince(start);
+		}
+
+		return true;
+	}
+
+	HuffmanCodeTable codeTable;
+
+	if (!codeTable.deserialize(stream))
+	{
+		HuffmanError() << "Invalid code table";
+		return false;
+	}
+
+	HuffmanDecodeTable localTable;
+	HuffmanDecodeTable& decodeTable = scratch ? scratch->decodeTable : localTable;
+
+	if (!decodeTable.build(codeTable))
+	{
+		HuffmanError() << "Unable to build decoding table";
+		return false;
+	}
+
+	if (stats)
+	{
+		stats->tableTime = secondsSince(start);
+		start = steady_clock::now();
+	}
+
+	const bool decoded = (streamCount == 1) ?
+		huffmanDecodeCharacters(decodeTable, stream, text, textSize) :
+		decodeInterleavedStreams(decodeTable, stream, text, textSize, streamCount);
+
+	if (stats && decoded)
+	{
+		stats->codingTime = secondsSince(start);
+		start = steady_clock::now();
+
+		huffmanHistogram(text, textSize, stats->counts);
+		fillCodeStats(codeTable, *stats);
+
+		stats->histogramTime = secondsSince(start);
+	}
+
+	return decoded;
+}
+
+bool huffmanDecodeBlockFrom(BitReader& stream, size_t bitOffset, uint8_t* text, size_t textSize, SHuffmanBlockScratch* scratch)
+{
+	EHuffmanBlockType type = HUFFMAN_BLOCK_CODED;
+
+	if (!readBlockType(stream, type))
+		return false;
+
+	if (type == HUFFMAN_BLOCK_SPLIT)
+	{
+		HuffmanError() << "Split blocks have no checkpoints";
+		return false;
+	}
+
+	if (type != HUFFMAN_BLOCK_CODED)
+		return decodeUncodedBlock(type, stream, bitOffset, text, textSize);
+
+	HuffmanCodeTable codeTable;
+
+	if (!codeTable.deserialize(stream))
+	{
+		HuffmanError() << "Invalid code table";
+		return false;
+	}
+
+	//Codes start after the code table
+	if (bitOffset < stream.getRead() || bitOffset > stream.getBitCount())
+	{
+		HuffmanError() << "Invalid checkpoint bit offset " << bitOffset;
+		return false;
+	}
+
+	HuffmanDecodeTable localTable;
+	HuffmanDecodeTable& decodeTable = scratch ? scratch->decodeTable : localTable;
+
+	if (!decodeTable.build(codeTable))
+	{
+		HuffmanError() << "Unable to build decoding table";
+		return false;
+	}
+
+	stream.seek(bitOffset);
+
+	return huffmanDecodeCharacters(decodeTable, stream, text, textSize);
+}
+
+size_t huffmanBlockBound(size_t textSize, unsigned int streamCount, uint32_t maxCodeLength)
+{
+	//Largest code table, then codes of up to maxCodeLength bits per character
+	const size_t tableBits = HuffmanCodeTable::maxSerializedBits;
+
+	//Interleaved bitstreams add a 32 bit jump table entry and up to a byte of padding each
+	const size_t streamBytes = (streamCount > 1) ? (streamCount * (sizeof(uint32_t) + 1)) : 0;
+
+	return ((tableBits + CHAR_BIT - 1) / CHAR_BIT) + ((textSize * maxCodeLength + CHAR_BIT - 1) / CHAR_BIT) + streamBytes;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,226 @@
+/*
+	Block format
+
+	Streams of text are split into independent blocks, each holding its own code table and encoded characters,
+	so a stream can be encoded and decoded one block at a time, and a range of text can be decoded from the
+	blocks holding it
+*/
+
+#pragma once
+
+#include "bitstream.h"
+#include "huffmanTable.h"
+
+#include <cstdint>
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+	Block stream layout:
+	 - SHuffmanStreamHeader
+	 - blocks, each a SHuffmanBlockHeader followed by a bitstream of bitcount bits holding the code table and the encoded characters
+	 - a SHuffmanBlockHeader with a size of 0 marks the end of the stream
+	 - block index, a SHuffmanBlockIndexEntry for every block
+	 - checkpoint index, a SHuffmanCheckpoint for every checkpointInterval characters of text, if checkpointInterval is not 0
+	 - SHuffmanIndexFooter, the last bytes of the stream
+
+	Decoders reading blocks in order stop at the end marker and never need the indexes.
+	Streams with checkpoints have a single bitstream per block, and every block but the last holds blockSize characters,
+	a multiple of checkpointInterval, so the start of every block is also a checkpoint.
+*/
+struct SHuffmanStreamHeader
+{
+	//"HUFB", distinguishes block streams from the bitcount at the start of single buffer encoded text
+	enum { magicValue = 0x42465548 };
+
+	//Version 2 added streamCount, version 1 headers end before it and have a single bitstream per block
+	//Version 3 added checkpointInterval, older headers end before it and have no checkpoints
+	//Version 4 added raw, run and split blocks, see EHuffmanBlockType
+	enum { currentVersion = 4 };
+
+	uint32_t magic = magicValue;
+	uint32_t version = currentVersion;
+	uint32_t blockSize = 0;				//Maximum number of characters in a block
+	uint32_t streamCount = 1;			//Number of interleaved bitstreams in each block
+	uint32_t checkpointInterval = 0;	//Number of characters between checkpoints, 0 if the stream has none
+};
+
+struct SHuffmanBlockHeader
+{
+	uint32_t size = 0;			//Number of characters in the block
+	uint32_t bitcount = 0;		//Number of bits in the block bitstream
+};
+
+//Location of a block within a stream
+struct SHuffmanBlockIndexEntry
+{
+	uint64_t offset = 0;		//Offset of the block header from the start of the stream
+	uint32_t size = 0;			//Number of characters in the block
+	uint32_t bitcount = 0;		//Number of bits in the block bitstream
+};
+
+//Point in a stream from which text can be decoded without decoding the text before it
+struct SHuffmanCheckpoint
+{
+	uint64_t textOffset = 0;	//Offset of the next character from the start of the text
+	uint32_t block = 0;			//Index of the block holding the character, whose code table decodes it
+	uint32_t bitOffset = 0;		//Offset of the code of the character from the start of the block bitstream
+};
+
+struct SHuffmanIndexFooter
+{
+	//"HUFX"
+	enum { magicValue = 0x58465548 };
+
+	uint64_t indexOffset = 0;	//Offset of the first index entry from the start of the stream
+	uint32_t blockCount = 0;
+	uint32_t magic = magicValue;
+};
+
+/*
+	Block types
+
+	Coded blocks start with their code table, whose first 3 bits are never 0. Other blocks start with 3 clear bits
+	followed by their type in 2 bits, padding to a whole byte, and then:
+	 - raw blocks, every character of the block as a byte
+	 - run blocks, the single character repeated for the whole block
+	 - split blocks, the number of parts in 8 bits, the number of characters and of bits of every part in 32 bits each,
+	   then every part as a coded, raw or run block padded to a whole byte
+*/
+enum EHuffmanBlockType
+{
+	HUFFMAN_BLOCK_CODED = 0,
+	HUFFMAN_BLOCK_RAW = 1,
+	HUFFMAN_BLOCK_RUN = 2,
+	HUFFMAN_BLOCK_SPLIT = 3
+};
+
+//Default number of characters in a block
+const size_t HUFFMAN_DEFAULT_BLOCK_SIZE = 1024 * 1024;
+
+//Largest allowed block size, keeps the bitcount of a block within 32 bits
+const size_t HUFFMAN_MAX_BLOCK_SIZE = 64 * 1024 * 1024;
+
+//Largest number of interleaved bitstreams in a block
+const unsigned int HUFFMAN_MAX_STREAM_COUNT = 16;
+
+//Compression levels, see huffmanEncodeBlock
+const unsigned int HUFFMAN_MIN_LEVEL = 1;
+const unsigned int HUFFMAN_DEFAULT_LEVEL = 3;
+const unsigned int HUFFMAN_MAX_LEVEL = 5;
+
+//Longest code of the sampled code tables of levels below HUFFMAN_DEFAULT_LEVEL, short enough for
+//huffmanEncodeCharacters to write the codes of 4 characters at once
+const uint32_t HUFFMAN_FAST_CODE_LENGTH = 14;
+
+//Largest number of parts in a split block, and number of bitstreams holding the parts of every split tried
+const unsigned int HUFFMAN_MAX_SPLIT_PARTS = 4;
+const unsigned int HUFFMAN_SPLIT_WRITER_COUNT = 2 * HUFFMAN_MAX_SPLIT_PARTS - 1;
+
+//Statistics of encoding or decoding a single block
+struct SHuffmanBlockStats
+{
+	uint32_t counts[HuffmanCodeTable::size] = {};	//Number of times each character occurs in the block
+	uint64_t payloadBits = 0;						//Bits of encoded characters, not counting the code table or padding
+	uint32_t maxCodeLength = 0;						//Length of the longest code used by the block
+
+	//Seconds spent in each stage, decoders only take the histogram of the decoded text for these statistics
+	double histogramTime = 0;
+	double tableTime = 0;
+	double codingTime = 0;
+};
+
+//Memory reused by every block coded with it, so once it has grown to fit the largest block, blocks are coded without allocating
+struct SHuffmanBlockScratch
+{
+	BitWriter substreams[HUFFMAN_MAX_STREAM_COUNT];		//Interleaved bitstreams being encoded
+	BitWriter splitParts[HUFFMAN_SPLIT_WRITER_COUNT];	//Parts of the splits of a block being tried
+	HuffmanDecodeTable decodeTable;						//Decoding table of the block being decoded
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+	Encodes a block of at least one character, writing its code table followed by the encoded characters
+
+	The type of the block is chosen from its histogram: blocks of a single character are written as run blocks,
+	and blocks whose codes and code table would not be smaller than their characters are written as raw blocks
+
+	Levels trade speed for size:
+	 - 1 and 2 build the code table from a sample of 1/16 and 1/4 of the block, giving every character missing from it
+	   a long code, so the block is read once to encode it, and write it raw if its codes turn out no smaller
+	   Their codes are at most HUFFMAN_FAST_CODE_LENGTH bits long so they are written several at a time
+	 - 3 counts every character of the block
+	 - 4 also encodes the block as 2 parts with code tables of their own, 5 as 2 and 4 parts, and writes the smallest
+
+	With a streamCount above 1, character i is encoded to bitstream (i % streamCount) so the decoder can follow
+	several independent bitstreams at once. The code table is then followed by:
+	 - the size in bytes of every bitstream but the last, 32 bits each
+	 - padding to a whole byte
+	 - the bitstreams, each padded to a whole byte
+
+	Statistics of the block are filled in if stats is not null, otherwise no time is spent on them
+	Without scratch memory the interleaved bitstreams are allocated for the block
+
+	With a checkpointInterval, checkpoints[k] is set to the bit offset of the code of character (k * checkpointInterval),
+	checkpoints must hold an entry for every checkpoint in the block and streamCount must be 1
+	Checkpoints of raw blocks are the offsets of their characters, and those of run blocks the offset of their character
+	Blocks with checkpoints are never split
+*/
+bool huffmanEncodeBlock(
+	const uint8_t* text,
+	size_t textSize,
+	uint32_t maxCodeLength,
+	unsigned int streamCount,
+	BitWriter& stream,
+	SHuffmanBlockStats* stats = nullptr,
+	SHuffmanBlockScratch* scratch = nullptr,
+	size_t checkpointInterval = 0,
+	uint32_t* checkpoints = nullptr,
+	unsigned int level = HUFFMAN_DEFAULT_LEVEL
+);
+
+//Decodes a block of textSize characters written by huffmanEncodeBlock with the same streamCount, of any block type
+//Statistics of the block are filled in if stats is not null, without scratch memory the decoding table is allocated for the block
+bool huffmanDecodeBlock(
+	BitReader& stream,
+	uint8_t* text,
+	size_t textSize,
+	unsigned int streamCount,
+	SHuffmanBlockStats* stats = nullptr,
+	SHuffmanBlockScratch* scratch = nullptr
+);
+
+//Decodes textSize characters of a block with a single bitstream, starting from the code at bitOffset such as a checkpoint
+//The code table at the start of the block is read first, so stream must hold the block from its start
+bool huffmanDecodeBlockFrom(
+	BitReader& stream,
+	size_t bitOffset,
+	uint8_t* text,
+	size_t textSize,
+	SHuffmanBlockScratch* scratch = nullptr
+);
+
+//Encodes every character of some text to a single bitstream with an existing code table, the table itself is not written
+//Returns false if a character has no code
+bool huffmanEncodeCharacters(
+	const HuffmanCodeTable& table,
+	const uint8_t* text,
+	size_t textSize,
+	BitWriter& stream
+);
+
+//Decodes textSize characters from a single bitstream written by huffmanEncodeCharacters
+//Returns false if a code is invalid or the bitstream ends first
+bool huffmanDecodeCharacters(
+	const HuffmanDecodeTable& decodeTable,
+	BitReader& stream,
+	uint8_t* text,
+	size_t textSize
+);
+
+//Returns the largest number of bytes the bitstream of a block of textSize characters can take
+//Blocks encoded with a lower code length limit than HuffmanCodeTable::maxCodeLength have a lower bound
+size_t huffmanBlockBound(size_t textSize, unsigned int streamCount = 1, uint32_t maxCodeLength = HuffmanCodeTable::maxCodeLength);
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,318 @@
+/*
+	Dictionaries
+*/
+
+#include "huffmanDictionary.h"
+#include "huffmanBlock.h"
+#include "huffmanHistogram.h"
+#include "huffmanError.h"
+
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//Largest number of bits of serialized code lengths, a length field of up to 6 bits for every character
+const size_t maxTableBits = 3 + HuffmanCodeTable::size * 7;
+
+bool HuffmanDictionary::train(const uint8_t* samples, size_t sampleSize, uint32_t maxCodeLength)
+{
+	uint64_t counts[HuffmanCodeTable::size] = {};
+	huffmanHistogramAdd(samples, sampleSize, counts);
+
+	return train(counts, maxCodeLength);
+}
+
+bool HuffmanDictionary::train(const uint64_t counts[HuffmanCodeTable::size], uint32_t maxCodeLength)
+{
+	m_valid = false;
+
+	//Counts are scaled down to fit 32 bit frequencies, and every frequency is at least 1 so every character gets a code
+	const uint64_t maxCount = *max_element(counts, counts + HuffmanCodeTable::size);
+	uint32_t shift = 0;
+
+	while ((maxCount >> shift) >= UINT32_MAX)
+		shift++;
+
+	uint32_t frequencies[HuffmanCodeTable::size];
+
+	for (size_t ch = 0; ch < HuffmanCodeTable::size; ch++)
+		frequencies[ch] = (uint32_t)(counts[ch] >> shift) + 1;
+
+	uint8_t lengths[HuffmanCodeTable::size];
+
+	if (!huffmanCodeLengths(frequencies, lengths))
+	{
+		HuffmanError() << "Unable to build code table";
+		return false;
+	}
+
+	//Codes are too long, rebuild the code lengths within the length limit
+	if (*max_element(lengths, lengths + HuffmanCodeTable::size) > maxCodeLength && !huffmanLimitedCodeLengths(frequencies, maxCodeLength, lengths))
+	{
+		HuffmanError() << "Unable to fit codes in " << maxCodeLength << " bits";
+		return false;
+	}
+
+	return setLengths(lengths);
+}
+
+bool HuffmanDictionary::setLengths(const uint8_t lengths[HuffmanCodeTable::size])
+{
+	m_valid = false;
+
+	if (!m_table.buildCanonical(lengths) || !m_decodeTable.build(m_table))
+	{
+		HuffmanError() << "Unable to build code table";
+		return false;
+	}
+
+	//FNV-1a hash of the code lengths, which decide every code of a canonical table
+	m_id = 2166136261u;
+
+	for (size_t ch = 0; ch < HuffmanCodeTable::size; ch++)
+	{
+		m_id ^= lengths[ch];
+		m_id *= 16777619u;
+	}
+
+	m_valid = true;
+
+	return true;
+}
+
+bool HuffmanDictionary::save(ostream& stream) const
+{
+	if (!m_valid)
+		return false;
+
+	BitWriter bitstream(maxTableBits);
+	m_table.serialize(bitstream);
+	bitstream.flush();
+
+	SHuffmanDictionaryHeader header;
+	header.id = m_id;
+	header.bitcount = (uint32_t)bitstream.getBitCount();
+
+	stream.write(reinterpret_cast<const char*>(&header), sizeof(SHuffmanDictionaryHeader));
+	stream.write(reinterpret_cast<const char*>(bitstream.getBitBuffer()), bitstream.getByteCount());
+
+	return stream.good();
+}
+
+bool HuffmanDictionary::load(istream& stream)
+{
+	m_valid = false;
+
+	SHuffmanDictionaryHeader header;
+	stream.read(reinterpret_cast<char*>(&header), sizeof(SHuffmanDictionaryHeader));
+
+	if (!stream.good() || header.magic != SHuffmanDictionaryHeader::magicValue || header.version != SHuffmanDictionaryHeader::currentVersion ||
+		header.bitcount == 0 || header.bitcount > maxTableBits)
+	{
+		HuffmanError() << "Invalid dictionary header";
+		return false;
+	}
+
+	vector<uint8_t> buffer((header.bitcount + CHAR_BIT - 1) / CHAR_BIT);
+	stream.read(reinterpret_cast<char*>(buffer.data()), buffer.size());
+
+	BitReader bitstream(buffer.data(), header.bitcount);
+
+	if (!stream.good() || !m_table.deserialize(bitstream))
+	{
+		HuffmanError() << "Invalid dictionary code table";
+		return false;
+	}
+
+	uint8_t lengths[HuffmanCodeTable::size];
+
+	for (size_t ch = 0; ch < HuffmanCodeTable::size; ch++)
+		lengths[ch] = (uint8_t)m_table[(uint8_t)ch].length;
+
+	if (!setLengths(lengths))
+		return false;
+
+	//Id is stored so a damaged code table is not mistaken for another dictionary
+	if (m_id != header.id)
+	{
+		HuffmanError() << "Dictionary id does not match its code table";
+		m_valid = false;
+		return false;
+	}
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool HuffmanDictionarySet::add(const HuffmanDictionary& dictionary)
+{
+	if (!dictionary.isValid())
+		return false;
+
+	const HuffmanDictionary* existing = find(dictionary.getId());
+
+	if (existing)
+	{
+		//Adding the same dictionary again is allowed
+		for (size_t ch = 0; ch < HuffmanCodeTable::size; ch++)
+		{
+			if (existing->getCodeTable()[(uint8_t)ch].length != dictionary.getCodeTable()[(uint8_t)ch].length)
+			{
+				HuffmanError() << "Another dictionary has the id " << dictionary.getId();
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	m_dictionaries.insert(make_pair(dictionary.getId(), dictionary));
+
+	return true;
+}
+
+const HuffmanDictionary* HuffmanDictionarySet::find(uint32_t id) const
+{
+	const auto it = m_dictionaries.find(id);
+
+	return (it != m_dictionaries.end()) ? &it->second : nullptr;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+size_t huffmanDictionaryCompressBound(size_t textSize, const HuffmanDictionary& dictionary)
+{
+	return sizeof(SHuffmanMessageHeader) + (textSize * dictionary.getCodeTable().getMaxLength() + CHAR_BIT - 1) / CHAR_BIT;
+}
+
+bool huffmanCompressWithDictionary(const uint8_t* text, size_t textSize, const HuffmanDictionary& dictionary, uint8_t* encodedText, size_t encodedCapacity, size_t& encodedSize)
+{
+	BitWriter bitstream;
+
+	return huffmanCompressWithDictionary(text, textSize, dictionary, encodedText, encodedCapacity, encodedSize, bitstream);
+}
+
+bool huffmanCompressWithDictionary(const uint8_t* text, size_t textSize, const HuffmanDictionary& dictionary, uint8_t* encodedText, size_t encodedCapacity, size_t& encodedSize,
+	BitWriter& bitstream)
+{
+	encodedSize = 0;
+
+	if (!dictionary.isValid())
+	{
+		HuffmanError() << "Dictionary has not been trained or loaded";
+		return false;
+	}
+
+	if (textSize > HUFFMAN_MAX_MESSAGE_SIZE)
+	{
+		HuffmanError() << "Messages must be no larger than " << HUFFMAN_MAX_MESSAGE_SIZE << "B";
+		return false;
+	}
+
+	bitstream.clear();
+	bitstream.reserve((huffmanDictionaryCompressBound(textSize, dictionary) - sizeof(SHuffmanMessageHeader)) * CHAR_BIT);
+
+	if (!huffmanEncodeCharacters(dictionary.getCodeTable(), text, textSize, bitstream))
+		return false;
+
+	const size_t size = sizeof(SHuffmanMessageHeader) + bitstream.getByteCount();
+
+	if (size > encodedCapacity)
+	{
+		HuffmanError() << "Encoded text does not fit in " << encodedCapacity << "B, see huffmanDictionaryCompressBound";
+		return false;
+	}
+
+	SHuffmanMessageHeader header;
+	header.dictionaryId = dictionary.getId();
+	header.size = (uint32_t)textSize;
+
+	memcpy(encodedText, &header, sizeof(SHuffmanMessageHeader));
+
+	if (bitstream.getByteCount())
+		memcpy(encodedText + sizeof(SHuffmanMessageHeader), bitstream.getBitBuffer(), bitstream.getByteCount());
+
+	encodedSize = size;
+
+	return true;
+}
+
+bool huffmanMessageInfo(const uint8_t* encodedText, size_t encodedSize, uint32_t& dictionaryId, size_t& textSize)
+{
+	if (encodedSize < sizeof(SHuffmanMessageHeader))
+		return false;
+
+	SHuffmanMessageHeader header;
+	memcpy(&header, encodedText, sizeof(SHuffmanMessageHeader));
+
+	dictionaryId = header.dictionaryId;
+	textSize = header.size;
+
+	return true;
+}
+
+bool huffmanDecompressWithDictionary(const uint8_t* encodedText, size_t encodedSize, const HuffmanDictionary& dictionary, uint8_t* text, size_t textCapacity, size_t& textSize)
+{
+	uint32_t dictionaryId = 0;
+	size_t size = 0;
+
+	textSize = 0;
+
+	if (!huffmanMessageInfo(encodedText, encodedSize, dictionaryId, size))
+	{
+		HuffmanError() << "Encoded text is too short to be a message";
+		return false;
+	}
+
+	if (!dictionary.isValid() || dictionaryId != dictionary.getId())
+	{
+		HuffmanError() << "Message was compressed with dictionary " << dictionaryId;
+		return false;
+	}
+
+	if (size > textCapacity)
+	{
+		HuffmanError() << "Decoded text does not fit in " << textCapacity << "B, see huffmanMessageInfo";
+		return false;
+	}
+
+	BitReader bitstream(encodedText + sizeof(SHuffmanMessageHeader), (encodedSize - sizeof(SHuffmanMessageHeader)) * CHAR_BIT);
+
+	if (!huffmanDecodeCharacters(dictionary.getDecodeTable(), bitstream, text, size))
+		return false;
+
+	textSize = size;
+
+	return true;
+}
+
+bool huffmanDecompressWithDictionary(const uint8_t* encodedText, size_t encodedSize, const HuffmanDictionarySet& dictionaries, uint8_t* text, size_t textCapacity, size_t& textSize)
+{
+	uint32_t dictionaryId = 0;
+	size_t size = 0;
+
+	textSize = 0;
+
+	if (!huffmanMessageInfo(encodedText, encodedSize, dictionaryId, size))
+	{
+		HuffmanError() << "Encoded text is too short to be a message";
+		return false;
+	}
+
+	const HuffmanDictionary* dictionary = dictionaries.find(dictionaryId);
+
+	if (!dictionary)
+	{
+		HuffmanError() << "No dictionary has the id " << dictionaryId;
+		return false;
+	}
+
+	return huffmanDecompressWithDictionary(encodedText, encodedSize, *dictionary, text, textCapacity, textSize);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
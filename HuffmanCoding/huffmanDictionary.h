@@ -0,0 +1,168 @@
+/*
+	Dictionaries
+
+	A dictionary is a code table trained once on samples of typical text, such as the payloads of one kind of message.
+	Messages compressed with a dictionary hold only the dictionary id and the encoded characters, without a code table,
+	so texts of a few hundred bytes still compress, and no table is built for each message.
+*/
+
+#pragma once
+
+#include "huffmanTable.h"
+#include "bitstream.h"
+
+#include <istream>
+#include <ostream>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+	Dictionary file layout:
+	 - SHuffmanDictionaryHeader
+	 - bitstream of bitcount bits holding the code lengths, as written by HuffmanCodeTable::serialize
+*/
+struct SHuffmanDictionaryHeader
+{
+	//"HUFD"
+	enum { magicValue = 0x44465548 };
+
+	enum { currentVersion = 1 };
+
+	uint32_t magic = magicValue;
+	uint32_t version = currentVersion;
+	uint32_t id = 0;			//Id of the dictionary, a hash of its code lengths
+	uint32_t bitcount = 0;		//Number of bits of code lengths
+};
+
+/*
+	Dictionary message layout:
+	 - SHuffmanMessageHeader
+	 - the encoded characters, padded to a whole byte
+*/
+struct SHuffmanMessageHeader
+{
+	uint32_t dictionaryId = 0;	//Id of the dictionary the message was compressed with
+	uint32_t size = 0;			//Number of characters in the message
+};
+
+//Largest number of characters in a dictionary message
+const size_t HUFFMAN_MAX_MESSAGE_SIZE = UINT32_MAX;
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class HuffmanDictionary
+{
+public:
+
+	//Builds the code table from the characters of some sample text
+	//Every character gets a code, characters missing from the samples get the longest codes, so any text can be compressed
+	bool train(const uint8_t* samples, size_t sampleSize, uint32_t maxCodeLength = HuffmanCodeTable::defaultLengthLimit);
+
+	//Builds the code table from the number of times each character occurs in the samples
+	bool train(const uint64_t counts[HuffmanCodeTable::size], uint32_t maxCodeLength = HuffmanCodeTable::defaultLengthLimit);
+
+	//Writes the dictionary file
+	bool save(std::ostream& stream) const;
+
+	//Reads a dictionary file, returns false if it is not a valid dictionary
+	bool load(std::istream& stream);
+
+	//Returns false until the dictionary has been trained or loaded
+	bool isValid() const { return m_valid; }
+
+	uint32_t getId() const { return m_id; }
+	const HuffmanCodeTable& getCodeTable() const { return m_table; }
+
+	//Decoding table, built once when the dictionary is trained or loaded
+	const HuffmanDecodeTable& getDecodeTable() const { return m_decodeTable; }
+
+private:
+
+	//Builds the code and decoding tables and the id from the code length of every character
+	bool setLengths(const uint8_t lengths[HuffmanCodeTable::size]);
+
+	HuffmanCodeTable m_table;
+	HuffmanDecodeTable m_decodeTable;
+	uint32_t m_id = 0;
+	bool m_valid = false;
+};
+
+//Dictionaries known to a decoder, looked up by the id of each message
+//Lookups do not modify the set, so once filled it can be shared by any number of threads
+class HuffmanDictionarySet
+{
+public:
+
+	//Adds a valid dictionary, returns false if it is invalid or a different dictionary has the same id
+	bool add(const HuffmanDictionary& dictionary);
+
+	//Returns the dictionary with an id, or null if there is none
+	const HuffmanDictionary* find(uint32_t id) const;
+
+	size_t size() const { return m_dictionaries.size(); }
+
+private:
+
+	std::unordered_map<uint32_t, HuffmanDictionary> m_dictionaries;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//Largest size of a message of textSize characters compressed with a dictionary
+size_t huffmanDictionaryCompressBound(size_t textSize, const HuffmanDictionary& dictionary);
+
+//Compresses text into a message referencing dictionary, encodedSize is set to the size of the message
+//Returns false if the message does not fit in encodedCapacity bytes, huffmanDictionaryCompressBound bytes are always enough
+bool huffmanCompressWithDictionary(
+	const uint8_t* text,
+	size_t textSize,
+	const HuffmanDictionary& dictionary,
+	uint8_t* encodedText,
+	size_t encodedCapacity,
+	size_t& encodedSize
+);
+
+//Compresses text as above, encoding it to a bitstream reused across calls so no memory is allocated once it has grown
+bool huffmanCompressWithDictionary(
+	const uint8_t* text,
+	size_t textSize,
+	const HuffmanDictionary& dictionary,
+	uint8_t* encodedText,
+	size_t encodedCapacity,
+	size_t& encodedSize,
+	BitWriter& bitstream
+);
+
+//Reads the dictionary id and the number of characters of a message, returns false if it is too short to be a message
+bool huffmanMessageInfo(
+	const uint8_t* encodedText,
+	size_t encodedSize,
+	uint32_t& dictionaryId,
+	size_t& textSize
+);
+
+//Decompresses a message compressed with dictionary, textSize is set to the number of characters decoded
+//Returns false if the message references another dictionary or does not fit in textCapacity bytes
+bool huffmanDecompressWithDictionary(
+	const uint8_t* encodedText,
+	size_t encodedSize,
+	const HuffmanDictionary& dictionary,
+	uint8_t* text,
+	size_t textCapacity,
+	size_t& textSize
+);
+
+//Decompresses a message compressed with any dictionary of a set
+bool huffmanDecompressWithDictionary(
+	const uint8_t* encodedText,
+	size_t encodedSize,
+	const HuffmanDictionarySet& dictionaries,
+	uint8_t* text,
+	size_t textCapacity,
+	size_t& textSize
+);
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -3,392 +3,2287 @@
 */
 
 #include "huffmanEncoder.h"
+#include "huffmanTable.h"
+#include "huffmanBlock.h"
+#include "huffmanHistogram.h"
+#include "huffmanDictionary.h"
+#include "huffmanError.h"
+#include "threadpool.h"
+#include "pipeline.h"
 
 #include "binarytree.h"
 #include "bitstream.h"
 
-#include <iostream>
-#include <queue>
+#include <istream>
+#include <ostream>
 #include <sstream>
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+#include <functional>
 #include <chrono>
+#include <cmath>
+#include <thread>
+#include <atomic>
 
 using namespace std;
 using namespace std::chrono;
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-typedef BinaryTree<uint8_t> HuffmanTree;
-typedef HuffmanTree::NodeId HuffmanNode;
+/*
+	Encoded text layout:
+	 - SHuffmanTextHeader
+	 - bitstream of bitcount bits, holding the code table followed by the encoded characters
 
-struct SCharacter
-{
-	unsigned int frequency = 0;
-	unsigned char charCode = 0;
-	HuffmanNode treeNode = 0;
-};
+	The code table is either the code lengths of a canonical table, marked by a leading set bit,
+	or a serialized tree whose root is always a branch, marked by a leading clear bit.
 
+	Encoded text written before the header was versioned starts with a SHuffmanTreeHeader instead, whose 32 bit
+	bitcount limits the bitstream to 512MB and which does not hold the size of the text.
+*/
 struct SHuffmanTreeHeader
 {
 	uint32_t bitcount = 0;
 };
 
-//Comparison predicate - sort elements so charstructs with the smallest frequency are at the top of the queue
-struct CharacterCompare
+struct SHuffmanTextHeader
 {
-	bool operator()(const SCharacter& left, const SCharacter& right) const
-	{
-		//default is operator <
-		return (left.frequency > right.frequency);
-	}
+	//"HUFT", read in place of the bitcount of a SHuffmanTreeHeader
+	enum { magicValue = 0x54465548 };
+	enum { currentVersion = 1 };
+
+	uint32_t magic = magicValue;
+	uint32_t version = currentVersion;
+	uint64_t bitcount = 0;		//Number of bits in the bitstream
+	uint64_t textSize = 0;		//Number of characters in the decoded text
 };
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
-//functions
 
-static int findchar(const HuffmanTree& tree, HuffmanNode startNode, uint32_t pattern, uint8_t& ch)
+//Passes progress to the callback of some options whenever another progressInterval bytes of text are finished
+//Without a callback the next report is never reached, so updates cost a single comparison
+class ProgressReporter
 {
-	HuffmanNode curnode = startNode;
-	int depth = 0;
+public:
 
-	for (int i = 0; i < 32; i++)
+	ProgressReporter(const SHuffmanOptions& options, uint64_t textTotal, uint64_t encodedTotal) :
+		m_callback(options.progress),
+		m_interval(max<uint64_t>(options.progressInterval, 1)),
+		m_next(options.progress ? 0 : UINT64_MAX)
 	{
-		curnode = tree.getChildNode(curnode, (pattern & (1 << (31 - i))) != 0);
-		depth++;
+		m_progress.textTotal = textTotal;
+		m_progress.encodedTotal = encodedTotal;
+	}
 
-		if (tree.isNodeLeaf(curnode))
-		{
-			tree.getNodeValue(curnode, ch);
-			break;
-		}
+	bool enabled() const { return (bool)m_callback; }
+
+	//Number of bytes of text between reports, or all of them when there is no callback
+	uint64_t getInterval() const { return enabled() ? m_interval : UINT64_MAX; }
+
+	void update(uint64_t textBytes, uint64_t encodedBytes)
+	{
+		if (textBytes >= m_next)
+			report(textBytes, encodedBytes);
 	}
 
-	return depth;
-}
+	//Reports the final progress
+	void finish(uint64_t textBytes, uint64_t encodedBytes)
+	{
+		if (enabled())
+			report(textBytes, encodedBytes);
+	}
+
+private:
 
-//Check if character exists in huffman tree
-static bool findpattern(const HuffmanTree& tree, HuffmanNode node, uint8_t c, uint32_t& pattern, uint32_t& depth)
+	void report(uint64_t textBytes, uint64_t encodedBytes)
+	{
+		m_progress.textBytes = textBytes;
+		m_progress.encodedBytes = encodedBytes;
+		m_next = textBytes + m_interval;
+
+		m_callback(m_progress);
+	}
+
+	const HuffmanProgressCallback& m_callback;
+	SHuffmanProgress m_progress;
+	uint64_t m_interval;
+	uint64_t m_next;
+};
+
+//Sums the statistics of every block into the statistics of the whole text, does nothing if stats is null
+class StatsCollector
 {
-	//Character or node cannot be null
-	if (!tree.isNode(node))
-		return false;
+public:
+
+	explicit StatsCollector(SHuffmanStats* stats) :
+		m_stats(stats)
+	{
+		if (m_stats)
+		{
+			*m_stats = SHuffmanStats();
+			m_start = steady_clock::now();
+		}
+	}
 
-	uint8_t ch = 0;
-	HuffmanNode left = tree.getChildNodeLeft(node);
-	HuffmanNode right = tree.getChildNodeRight(node);
+	bool enabled() const { return m_stats != nullptr; }
 
-	if (tree.isNodeLeaf(node))
+	//Statistics to pass to a block encoder or decoder, null if statistics are not collected
+	SHuffmanBlockStats* blockStats(SHuffmanBlockStats& block) const { return m_stats ? &block : nullptr; }
+
+	void addBlock(const SHuffmanBlockStats& block, size_t size, bool encoding)
 	{
-		tree.getNodeValue(node, ch);
-		if (ch == c)
-			return true;
+		if (!m_stats)
+			return;
+
+		addCounts(block.counts);
+
+		m_stats->payloadBits += block.payloadBits;
+		m_stats->symbolCount += size;
+		m_stats->maxCodeLength = max(m_stats->maxCodeLength, block.maxCodeLength);
+
+		m_stats->histogramTime += block.histogramTime;
+		m_stats->tableTime += block.tableTime;
+		(encoding ? m_stats->encodeTime : m_stats->decodeTime) += block.codingTime;
 	}
 
-	//Search left branch recursively
-	// 0
-	if (findpattern(tree, left, c, pattern, depth))
+	//Adds the counts of characters of text of any size, such as single buffer encoded text, whose counts may not fit in a block
+	template<typename Count>
+	void addCounts(const Count counts[HuffmanCodeTable::size])
 	{
-		//Shift pattern but do not insert a new bit (1010 -> 0101)
-		pattern = (pattern >> 1);
-		depth++;
-		return true;
+		if (!m_stats)
+			return;
+
+		for (size_t ch = 0; ch < HuffmanCodeTable::size; ch++)
+			m_counts[ch] += counts[ch];
 	}
 
-	//Search right branch recursively
-	// 1
-	if (findpattern(tree, right, c, pattern, depth))
+	//Fills in the totals once every block has been added, encodedBytes is the size of the encoded text
+	void finish(uint64_t inputBytes, uint64_t outputBytes, uint64_t encodedBytes, uint64_t blockCount)
 	{
-		//Shift pattern and insert new bit at front of pattern (1010 -> 1101)
-		pattern = (pattern >> 1) | (1 << 31);
-		depth++;
-		return true;
+		if (!m_stats)
+			return;
+
+		m_stats->inputBytes = inputBytes;
+		m_stats->outputBytes = outputBytes;
+		m_stats->blockCount = blockCount;
+		m_stats->headerBytes = encodedBytes - min(encodedBytes, m_stats->payloadBits / CHAR_BIT);
+
+		if (m_stats->symbolCount)
+		{
+			m_stats->averageCodeLength = (double)m_stats->payloadBits / m_stats->symbolCount;
+
+			for (uint64_t count : m_counts)
+			{
+				if (count)
+				{
+					const double p = (double)count / m_stats->symbolCount;
+					m_stats->entropy -= p * log2(p);
+				}
+			}
+		}
+
+		m_stats->totalTime = duration<double>(steady_clock::now() - m_start).count();
 	}
 
-	return false;
-}
+private:
+
+	SHuffmanStats* m_stats;
+	uint64_t m_counts[HuffmanCodeTable::size] = {};
+	steady_clock::time_point m_start;
+};
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-static void serializeNode(const HuffmanTree& tree, HuffmanNode node, BitStream& stream)
+//Reads a serialized tree node and its children, depth is the depth of the node
+static HuffmanNode deserializeNode(HuffmanTree& tree, uint32_t depth, BitReader& stream)
 {
-	if (!tree.isNode(node))
-		return;
+	//Truncated streams read as zeroes past the end, which would never reach a leaf
+	if (stream.overrun() || depth > HuffmanCodeTable::maxCodeLength)
+		return 0;
 
-	if (tree.isNodeLeaf(node))
+	if (stream.readbit())
 	{
-		stream.writebit(1);
-
-		uint8_t value = 0;
-		tree.getNodeValue(node, value);
-		stream.write(value);
+		uint8_t byte = (uint8_t)stream.read(8);
+		return tree.allocNode(byte);
 	}
 	else
 	{
-		stream.writebit(0);
-		serializeNode(tree, tree.getChildNodeLeft(node), stream);
-		serializeNode(tree, tree.getChildNodeRight(node), stream);
+		//Children are read first so the branch is allocated already linked to them
+		const HuffmanNode left = deserializeNode(tree, depth + 1, stream);
+		const HuffmanNode right = deserializeNode(tree, depth + 1, stream);
+
+		return tree.allocBranch(left, right);
 	}
 }
 
-static HuffmanNode deserializeNode(HuffmanTree& tree, HuffmanNode node, BitStream& stream)
+//Reads the code table at the start of the bitstream of single buffer encoded text
+static bool readSingleBufferTable(BitReader& bitstream, HuffmanCodeTable& codeTable)
 {
-	BitStream::bit_t bit = 0;
-	stream.readbit(bit);
-
-	if (bit == 1)
+	if (bitstream.readbit())
 	{
-		BitStream::byte_t byte = 0;
-		stream.read(byte);
-		return tree.allocNode(byte);
+		//Canonical code lengths
+		if (!codeTable.deserialize(bitstream))
+		{
+			HuffmanError() << "Invalid code table";
+			return false;
+		}
 	}
 	else
 	{
-		HuffmanNode parent = tree.allocNode(0);
-		
-		tree.linkNodeLeft(parent, deserializeNode(tree, node, stream));
-		tree.linkNodeRight(parent, deserializeNode(tree, node, stream));
+		//Serialized tree, the leading bit was the root branch
+		//A tree of 256 characters has 511 nodes
+		HuffmanTree tree;
+		tree.reserve(2 * HuffmanCodeTable::size - 1);
+
+		const HuffmanNode left = deserializeNode(tree, 1, bitstream);
+		const HuffmanNode right = deserializeNode(tree, 1, bitstream);
+		const HuffmanNode root = tree.allocBranch(left, right);
 
-		return parent;
+		if (!codeTable.build(tree, root))
+		{
+			HuffmanError() << "Invalid code tree";
+			return false;
+		}
 	}
+
+	return true;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-bool huffmanCompress(const string& text, ostream& encodedText)
+bool huffmanBuildCodeTable(const string& text, HuffmanCodeTable& table, uint32_t maxCodeLength)
 {
-	cout << "Beginning compression.\n";
+	return huffmanBuildCodeTable(reinterpret_cast<const uint8_t*>(text.data()), text.size(), table, maxCodeLength);
+}
 
-	//Binary tree
-	HuffmanTree tree;
-	//Root node of binary tree
-	HuffmanNode rootNode = 0;
+bool huffmanBuildCodeTable(const uint8_t* text, size_t textSize, HuffmanCodeTable& table, uint32_t maxCodeLength)
+{
+	//Number of times each character occurs in the text, which may be 4GB or more
+	uint64_t counts[HuffmanCodeTable::size] = {};
+	huffmanHistogramAdd(text, textSize, counts);
 
-	//Compressed stream
-	BitStream bitstream(text.size() * BitStream::bytewidth);
+	return huffmanBuildCodeTable(counts, table, maxCodeLength);
+}
 
-	cout << "Building tree...\n";
+bool huffmanBuildCodeTable(const uint64_t counts[HuffmanCodeTable::size], HuffmanCodeTable& table, uint32_t maxCodeLength)
+{
+	//Counts are scaled down to fit 32 bit frequencies, characters which occur keep a frequency of at least 1 so they keep a code
+	const uint64_t maxCount = *max_element(counts, counts + HuffmanCodeTable::size);
+	uint32_t shift = 0;
 
-	const uint32_t tableSize = numeric_limits<uint8_t>::max();
+	while ((maxCount >> shift) >= UINT32_MAX)
+		shift++;
 
-	//Table for tracking the frequency of characters
-	SCharacter frequencyTable[tableSize] = {};
+	uint32_t frequencies[HuffmanCodeTable::size];
 
-	//Fill character frequency table
-	for (char curChar : text)
-	{
-		frequencyTable[(size_t)curChar].charCode = curChar;
-		frequencyTable[(size_t)curChar].frequency++;
-	}
+	for (size_t ch = 0; ch < HuffmanCodeTable::size; ch++)
+		frequencies[ch] = (uint32_t)(counts[ch] >> shift) + ((shift && counts[ch]) ? 1 : 0);
+
+	return huffmanBuildCodeTable(frequencies, table, maxCodeLength);
+}
 
-	//Scan frequency table and sort characters into a character queue
-	priority_queue<SCharacter, vector<SCharacter>, CharacterCompare> alphabetQueue;
+bool huffmanBuildCodeTable(const uint32_t frequencies[HuffmanCodeTable::size], HuffmanCodeTable& table, uint32_t maxCodeLength)
+{
+	//Code length of each character
+	uint8_t lengths[HuffmanCodeTable::size] = {};
 
-	for (auto it = begin(frequencyTable); it != end(frequencyTable); it++)
+	if (!huffmanCodeLengths(frequencies, lengths))
 	{
-		if ((it->frequency != 0) && (it->charCode > 0))
-		{
-			SCharacter charStruct;
-			charStruct.frequency = it->frequency;
-			charStruct.charCode = it->charCode;
-			charStruct.treeNode = tree.allocNode(charStruct.charCode);
-			alphabetQueue.push(charStruct);
-		}
+		HuffmanError() << "Unable to build code table";
+		return false;
 	}
 
-	//////////////////////////////////////////////////////////////////////////////////////////////////////////
-	//Build tree from character queue
-
-	while (alphabetQueue.size() > 1)
+	//Codes are too long, rebuild the code lengths within the length limit
+	if (*max_element(begin(lengths), end(lengths)) > maxCodeLength && !huffmanLimitedCodeLengths(frequencies, maxCodeLength, lengths))
 	{
-		//Read two elements from the character queue at a time
+		HuffmanError() << "Unable to fit codes in " << maxCodeLength << " bits";
+		return false;
+	}
 
-		//First element in queue
-		SCharacter charStruct0(alphabetQueue.top());
-		alphabetQueue.pop();
+	//Assign the codes in canonical order
+	if (!table.buildCanonical(lengths) || (table.getMaxLength() == 0))
+	{
+		HuffmanError() << "Unable to build code table";
+		return false;
+	}
 
-		//Second element in queue
-		SCharacter charStruct1(alphabetQueue.top());
-		alphabetQueue.pop();
+	return true;
+}
 
-		BinaryTree<SCharacter>::NodeId right = 0;
-		BinaryTree<SCharacter>::NodeId left = 0;
+//Compresses text as single buffer encoded text, counts must hold the number of times each character occurs in it
+//encodedBytes is set to the number of bytes written, and the coding time and payload of block are filled in if it is not null
+static bool compressSingleBuffer(const string& text, const HuffmanCodeTable& table, const uint64_t counts[HuffmanCodeTable::size], ostream& encodedText, const SHuffmanOptions& options,
+	SHuffmanBlockStats* block, uint64_t& encodedBytes)
+{
+	//Only code lengths are stored so the codes must be reproducible from them
+	if (!text.empty() && !table.isCanonical())
+	{
+		HuffmanError() << "Code table is not canonical";
+		return false;
+	}
 
-		//Check if first queue element is greater than the second element
-		//The right-hand node must take the value with the larger frequency
-		if (charStruct0.frequency > charStruct1.frequency)
-		{
-			right = charStruct0.treeNode;
-			left = charStruct1.treeNode;
-		}
-		else
+	//Every character must have a code, checked before anything is written so no partial text is left in the stream
+	for (size_t ch = 0; ch < HuffmanCodeTable::size; ch++)
+	{
+		if (counts[ch] && table[(uint8_t)ch].length == 0)
 		{
-			right = charStruct1.treeNode;
-			left = charStruct0.treeNode;
+			HuffmanError() << "No pattern could be found for char '" << (char)ch << "'";
+			return false;
 		}
+	}
 
-		//Create parent char
-		SCharacter parentStruct;
-		parentStruct.charCode = 0;
-		parentStruct.frequency = charStruct1.frequency + charStruct0.frequency;
-		parentStruct.treeNode = tree.allocNode(0);
+	steady_clock::time_point start;
 
-		//Link child nodes to new parent node
-		tree.linkNodeLeft(parentStruct.treeNode, left);
-		tree.linkNodeRight(parentStruct.treeNode, right);
+	if (block)
+		start = steady_clock::now();
 
-		//Enqueue parent char
-		alphabetQueue.push(parentStruct);
+	//Compressed stream
+	BitWriter bitstream(text.size() * CHAR_BIT);
 
-		//Update root node to the most recent parent node each iteration
-		rootNode = parentStruct.treeNode;
-	}
+	//////////////////////////////////////////////////////////////////////////////////////////////////////////
+	//Serialize code lengths, empty text is stored as a header alone without a code table
 
-	cout << "Tree built.\n";
+	if (!text.empty())
+	{
+		bitstream.writebit(1);
+		table.serialize(bitstream);
+	}
 
-	//////////////////////////////////////////////////////////////////////////////////////////////////////////
-	//Serialize huffman codes from tree
+	const size_t tableBits = bitstream.getBitCount();
 
-	serializeNode(tree, rootNode, bitstream);
+	if (block)
+	{
+		block->tableTime += duration<double>(steady_clock::now() - start).count();
+		start = steady_clock::now();
+	}
 
 	//////////////////////////////////////////////////////////////////////////////////////////////////////////
 	//Begin compression
 
-	cout << "Encoding...\n";
-	cout << "0% completed";
+	ProgressReporter progress(options, text.size(), 0);
 
-	size_t charidx = 0;
+	//Text is encoded in runs between progress reports
+	const size_t runSize = (size_t)min<uint64_t>(progress.getInterval(), SIZE_MAX);
 
-	//Initial time
-	auto t0 = high_resolution_clock::now();
-
-	for (char c : text)
+	for (size_t runStart = 0; runStart < text.size(); )
 	{
-		uint32_t pattern = 0;
-		uint32_t depth = 0;
-
-		if (!findpattern(tree, rootNode, c, pattern, depth))
-		{
-			cerr << "No pattern could be found for char '" << c << "'\n";
-			continue;
-		}
+		const size_t runEnd = runStart + min(runSize, text.size() - runStart);
 
-		//Print encoding progress to console
-		charidx++;
-		if (((charidx * 100) % text.size()) == 0) //Only print every percentile as printing can be expensive
+		for (size_t i = runStart; i < runEnd; i++)
 		{
-			size_t perc = (charidx * 100) / text.size();
+			const SHuffmanCode& code = table[(uint8_t)text[i]];
 
-			//Print percentage complete and time
-			cout << "\r";
-			cout << perc << "% completed (" << duration_cast<milliseconds>(high_resolution_clock::now() - t0).count() << "ms): " << string((size_t)perc / 5, '|');
-			cout.flush();
+			//Write bit pattern to stream
+			bitstream.write(code.pattern, code.length);
 		}
 
-		//Write bit pattern to stream
-		bitstream.write(pattern, 0, depth);
+		runStart = runEnd;
+		progress.update(runStart, bitstream.getBitCount() / CHAR_BIT);
 	}
 
-	cout << endl;
-	cout << "Encoded.\n";
+	bitstream.flush();
+
+	if (block)
+	{
+		block->codingTime = duration<double>(steady_clock::now() - start).count();
+		block->payloadBits = bitstream.getBitCount() - tableBits;
+
+		for (size_t ch = 0; ch < HuffmanCodeTable::size; ch++)
+		{
+			if (counts[ch])
+				block->maxCodeLength = max(block->maxCodeLength, table[(uint8_t)ch].length);
+		}
+	}
 
 	//////////////////////////////////////////////////////////////////////////////////////////////////////////
 	//Write data to stream
 
 	//Header
-	SHuffmanTreeHeader header;
-	header.bitcount = (uint32_t)bitstream.getBitCount();
-
-	//Get initial position of write pointer
-	streampos encodedTextSize = encodedText.tellp();
+	SHuffmanTextHeader header;
+	header.bitcount = bitstream.getBitCount();
+	header.textSize = text.size();
 
 	//Write header
-	encodedText.write(reinterpret_cast<const char*>(&header), sizeof(SHuffmanTreeHeader));
+	encodedText.write(reinterpret_cast<const char*>(&header), sizeof(SHuffmanTextHeader));
 	assert(encodedText.good());
 	//Write encoded bitstream
 	encodedText.write(reinterpret_cast<const char*>(bitstream.getBitBuffer()), bitstream.getByteCount());
 	assert(encodedText.good());
 
-	//Get size of written data by subtracting original position of write pointer from the initial position
-	encodedTextSize = encodedText.tellp() - encodedTextSize;
+	encodedBytes = sizeof(SHuffmanTextHeader) + bitstream.getByteCount();
+	progress.finish(text.size(), encodedBytes);
 
-	//////////////////////////////////////////////////////////////////////////////////////////////////////////
+	return true;
+}
+
+bool huffmanCompress(const string& text, ostream& encodedText, const SHuffmanOptions& options, SHuffmanStats* stats)
+{
+	HuffmanErrorScope errors(options.error);
+
+	StatsCollector collector(stats);
+	SHuffmanBlockStats block;
 
-	cout << "Text length: " << text.size() << "B\n";
-	cout << "Compressed text length: " << encodedTextSize << "B\n";
-	cout << "Compression ratio: " << (float)encodedTextSize / text.size() << endl;
+	steady_clock::time_point start = steady_clock::now();
+
+	//Texts of 4GB or more are counted in parts, their counts do not fit in the block statistics
+	uint64_t counts[HuffmanCodeTable::size] = {};
+	huffmanHistogramAdd(reinterpret_cast<const uint8_t*>(text.data()), text.size(), counts);
+
+	block.histogramTime = duration<double>(steady_clock::now() - start).count();
+	start = steady_clock::now();
+
+	HuffmanCodeTable table;
+
+	//Empty text has no characters to build codes for
+	if (!text.empty() && !huffmanBuildCodeTable(counts, table, options.maxCodeLength))
+		return false;
+
+	block.tableTime = duration<double>(steady_clock::now() - start).count();
+
+	uint64_t encodedBytes = 0;
+
+	if (!compressSingleBuffer(text, table, counts, encodedText, options, collector.blockStats(block), encodedBytes))
+		return false;
+
+	collector.addBlock(block, text.size(), true);
+	collector.addCounts(counts);
+	collector.finish(text.size(), encodedBytes, encodedBytes, 0);
 
 	return true;
 }
 
-bool huffmanDecompress(istream& encodedText, ostream& decodedText)
+bool huffmanCompress(const string& text, const HuffmanCodeTable& table, ostream& encodedText, const SHuffmanOptions& options, SHuffmanStats* stats)
 {
-	cout << "Beginning decompression.\n";
+	HuffmanErrorScope errors(options.error);
 
-	//Read data header
-	SHuffmanTreeHeader header;
+	StatsCollector collector(stats);
+	SHuffmanBlockStats block;
 
-	encodedText.read(reinterpret_cast<char*>(&header), sizeof(SHuffmanTreeHeader));
-	assert(encodedText.good());
+	//Characters are counted to check that every one of them has a code
+	const steady_clock::time_point start = steady_clock::now();
 
-	size_t bytecount = header.bitcount / BitStream::bytewidth;
-	if (header.bitcount % BitStream::bytewidth)
-		bytecount++;
+	uint64_t counts[HuffmanCodeTable::size] = {};
+	huffmanHistogramAdd(reinterpret_cast<const uint8_t*>(text.data()), text.size(), counts);
 
-	vector<BitStream::byte_t> tempBitBuffer(bytecount);
-	encodedText.read(reinterpret_cast<char*>(&tempBitBuffer[0]), bytecount);
-	assert(encodedText.good());
+	block.histogramTime = duration<double>(steady_clock::now() - start).count();
 
-	//Create encoded text bitstream
-	BitStream bitstream((const BitStream::byte_t*)&tempBitBuffer[0], header.bitcount);
+	uint64_t encodedBytes = 0;
 
-	cout << "Rebuilding tree...\n";
+	if (!compressSingleBuffer(text, table, counts, encodedText, options, collector.blockStats(block), encodedBytes))
+		return false;
+
+	collector.addBlock(block, text.size(), true);
+	collector.addCounts(counts);
+	collector.finish(text.size(), encodedBytes, encodedBytes, 0);
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//A block being compressed by a worker thread
+struct SBlockJob
+{
+	const uint8_t* text = nullptr;
+	size_t size = 0;
+	vector<uint8_t> buffer;		//Text of the block when it is read from a stream
+	BitWriter bitstream;
+	vector<uint32_t> checkpoints;	//Bit offsets of the checkpoints of the block
+	SHuffmanBlockStats stats;
+	bool encoded = false;
+};
+
+//Fills jobs with the next batch of blocks, returns the number of blocks filled, fewer than jobs.size() at the end of the text
+typedef function<size_t(vector<SBlockJob>& jobs)> BlockReader;
+
+//Appends bytes to the encoded text, returns false if they cannot be written
+typedef function<bool(const void* data, size_t size)> EncodedWriter;
+
+//A batch of blocks moving through the compression pipeline
+struct SCompressBatch
+{
+	vector<SBlockJob> jobs;
+	size_t count = 0;			//Number of jobs holding a block
+};
+
+//Number of batches in the ring of a pipeline, one for each stage
+const size_t pipelineBatchCount = 3;
+
+//Size of text which is not known until it has been read
+const uint64_t unknownTextSize = UINT64_MAX;
+
+//Number of threads and blocks in a batch used to compress some text
+struct SCompressLayout
+{
+	unsigned int threadCount = 1;
+	size_t jobCount = 0;		//Number of blocks in a batch
+	size_t jobBlockSize = 0;	//Largest block in a batch, which sizes the block bitstreams
+};
+
+//Finds the layout for compressing textSize bytes, small texts use fewer threads and smaller bitstreams than a full batch
+static SCompressLayout compressLayout(const SHuffmanOptions& options, uint64_t textSize)
+{
+	SCompressLayout layout;
+	layout.threadCount = options.threadCount ? options.threadCount : max(thread::hardware_concurrency(), 1u);
+	layout.jobBlockSize = options.blockSize;
+
+	layout.jobCount = layout.threadCount * 2;
+
+	if (textSize != unknownTextSize)
+	{
+		const uint64_t blockCount = max<uint64_t>((textSize + options.blockSize - 1) / options.blockSize, 1);
+
+		layout.threadCount = (unsigned int)min<uint64_t>(layout.threadCount, blockCount);
+		layout.jobCount = (size_t)min<uint64_t>(layout.threadCount * 2, blockCount);
+		layout.jobBlockSize = (size_t)min<uint64_t>(options.blockSize, max<uint64_t>(textSize, 1));
+	}
+
+	return layout;
+}
+
+//Checks the block size and stream count of options for compressing a block stream
+static bool checkCompressOptions(const SHuffmanOptions& options)
+{
+	if (options.blockSize == 0 || options.blockSize > HUFFMAN_MAX_BLOCK_SIZE)
+	{
+		HuffmanError() << "Block size must be between 1 and " << HUFFMAN_MAX_BLOCK_SIZE << "B";
+		return false;
+	}
+
+	if (options.streamCount == 0 || options.streamCount > HUFFMAN_MAX_STREAM_COUNT)
+	{
+		HuffmanError() << "Stream count must be between 1 and " << HUFFMAN_MAX_STREAM_COUNT;
+		return false;
+	}
+
+	if (options.checkpointInterval && (options.streamCount != 1 || options.blockSize % options.checkpointInterval))
+	{
+		HuffmanError() << "Checkpoint interval must divide the block size and needs a single bitstream per block";
+		return false;
+	}
+
+	if (options.level < HUFFMAN_MIN_LEVEL || options.level > HUFFMAN_MAX_LEVEL)
+	{
+		HuffmanError() << "Level must be between " << HUFFMAN_MIN_LEVEL << " and " << HUFFMAN_MAX_LEVEL;
+		return false;
+	}
+
+	return true;
+}
+
+//Number of checkpoints in textSize characters, one at the start of every interval characters
+static uint64_t checkpointCount(uint64_t textSize, size_t interval)
+{
+	return interval ? (textSize + interval - 1) / interval : 0;
+}
+
+//Writes the header of a block stream, offset is set to the offset of the first block
+template<typename Writer>
+static bool writeStreamHeader(Writer& write, const SHuffmanOptions& options, uint64_t& offset)
+{
+	SHuffmanStreamHeader header;
+	header.blockSize = (uint32_t)options.blockSize;
+	header.streamCount = options.streamCount;
+	header.checkpointInterval = (uint32_t)options.checkpointInterval;
+
+	offset = sizeof(SHuffmanStreamHeader);
+
+	return write(&header, sizeof(SHuffmanStreamHeader));
+}
+
+//Writes an encoded block of size characters at offset and adds it to the block index, offset is moved past the block
+template<typename Writer>
+static bool writeBlock(Writer& write, const BitWriter& bitstream, size_t size, uint64_t& offset, vector<SHuffmanBlockIndexEntry>& index)
+{
+	SHuffmanBlockHeader blockHeader;
+	blockHeader.size = (uint32_t)size;
+	blockHeader.bitcount = (uint32_t)bitstream.getBitCount();
+
+	SHuffmanBlockIndexEntry entry;
+	entry.offset = offset;
+	entry.size = blockHeader.size;
+	entry.bitcount = blockHeader.bitcount;
+	index.push_back(entry);
+
+	offset += sizeof(SHuffmanBlockHeader) + bitstream.getByteCount();
+
+	return write(&blockHeader, sizeof(SHuffmanBlockHeader)) && write(bitstream.getBitBuffer(), bitstream.getByteCount());
+}
+
+//Adds the checkpoints of the last block added to index, which holds size characters from textOffset
+static void addCheckpoints(const uint32_t* bitOffsets, size_t size, size_t interval, uint64_t textOffset, const vector<SHuffmanBlockIndexEntry>& index,
+	vector<SHuffmanCheckpoint>& checkpoints)
+{
+	for (size_t k = 0; k < checkpointCount(size, interval); k++)
+	{
+		SHuffmanCheckpoint checkpoint;
+		checkpoint.textOffset = textOffset + k * interval;
+		checkpoint.block = (uint32_t)(index.size() - 1);
+		checkpoint.bitOffset = bitOffsets[k];
+		checkpoints.push_back(checkpoint);
+	}
+}
+
+//Writes the end marker, indexes and footer which follow the last block at offset, offset is moved to the end of the stream
+template<typename Writer>
+static bool writeStreamEnd(Writer& write, const vector<SHuffmanBlockIndexEntry>& index, const vector<SHuffmanCheckpoint>& checkpoints, uint64_t& offset)
+{
+	//Empty block marks the end of the stream
+	SHuffmanBlockHeader endHeader;
+
+	SHuffmanIndexFooter footer;
+	footer.indexOffset = offset + sizeof(SHuffmanBlockHeader);
+	footer.blockCount = (uint32_t)index.size();
+
+	offset = footer.indexOffset + index.size() * sizeof(SHuffmanBlockIndexEntry) + checkpoints.size() * sizeof(SHuffmanCheckpoint) + sizeof(SHuffmanIndexFooter);
+
+	return write(&endHeader, sizeof(SHuffmanBlockHeader)) &&
+		write(index.data(), index.size() * sizeof(SHuffmanBlockIndexEntry)) &&
+		write(checkpoints.data(), checkpoints.size() * sizeof(SHuffmanCheckpoint)) &&
+		write(&footer, sizeof(SHuffmanIndexFooter));
+}
+
+//Compresses blocks supplied by readBatch in batches of a couple of blocks per thread, writing the stream header, blocks and index
+//textTotal is the size of the text, or unknownTextSize
+//When pipelined, readBatch and write are called on threads of their own while the previous batch is encoded
+static bool compressBlocks(const EncodedWriter& write, const SHuffmanOptions& options, uint64_t textTotal, StatsCollector& collector, const BlockReader& readBatch,
+	bool pipelined)
+{
+	const size_t blockSize = options.blockSize;
+
+	if (!checkCompressOptions(options))
+		return false;
+
+	const SCompressLayout layout = compressLayout(options, textTotal);
+
+	ThreadPool pool(layout.threadCount);
 
-	HuffmanTree tree;
-	HuffmanNode root = 1;
-	deserializeNode(tree, 0, bitstream);
+	//Interleaved bitstreams and split candidates are encoded in memory of each thread, grown once to fit a block
+	vector<SHuffmanBlockScratch> scratches(pool.getThreadCount());
 
-	HuffmanNode curnode = root;
+	//Offset of the next write from the start of the stream, counted as the output may not be seekable
+	uint64_t offset = 0;
 
-	cout << "Tree rebuilt\n";
-	cout << "Decoding...\n";
-	cout << "0% completed";
+	if (!writeStreamHeader(write, options, offset))
+		return false;
+
+	vector<SHuffmanBlockIndexEntry> index;
+	vector<SHuffmanCheckpoint> checkpoints;
+
+	if (textTotal != unknownTextSize)
+	{
+		index.reserve((size_t)((textTotal + blockSize - 1) / blockSize));
+		checkpoints.reserve((size_t)checkpointCount(textTotal, options.checkpointInterval));
+	}
+
+	ProgressReporter progress(options, (textTotal != unknownTextSize) ? textTotal : 0, 0);
 
-	size_t initialRead = bitstream.getRead();				 //Initial position of the read pointer (in bits)
-	size_t dataSize = header.bitcount - bitstream.getRead(); //Size of the encoded data				(in bits)
+	//Bytes written so far, published by the writer for progress reports made on the calling thread
+	uint64_t textBytes = 0;
+	atomic<uint64_t> textWritten(0);
+	atomic<uint64_t> encodedWritten(offset);
 
-	auto t0 = high_resolution_clock::now();
+	//Text of a single batch has nothing to overlap with
+	if (textTotal != unknownTextSize && (textTotal + blockSize - 1) / blockSize <= layout.jobCount)
+		pipelined = false;
 
-	while ((header.bitcount - bitstream.getRead()) > 0)
+	//Only the batches of the ring are held in memory
+	vector<SCompressBatch> batches((pipelined && options.pipeline) ? pipelineBatchCount : 1);
+
+	for (SCompressBatch& batch : batches)
 	{
-		BitStream::bit_t bit = 0;
-		bitstream.readbit(bit);
+		batch.jobs.resize(layout.jobCount);
+
+		for (SBlockJob& job : batch.jobs)
+		{
+			job.bitstream = BitWriter(huffmanBlockBound(layout.jobBlockSize, options.streamCount, options.maxCodeLength) * CHAR_BIT);
+			job.checkpoints.resize((size_t)checkpointCount(layout.jobBlockSize, options.checkpointInterval));
+		}
+	}
+
+	SPipelineStages<SCompressBatch> stages;
 
-		curnode = tree.getChildNode(curnode, bit);
+	stages.read = [&readBatch](SCompressBatch& batch, bool& last)
+	{
+		batch.count = readBatch(batch.jobs);
+		last = (batch.count < batch.jobs.size());
+		return true;
+	};
 
-		if (tree.isNodeLeaf(curnode))
+	//Encode the batch on every thread, each block has its own code table and bitstream
+	stages.process = [&](SCompressBatch& batch)
+	{
+		pool.parallelFor(batch.count, ThreadPool::ThreadTask([&batch, &options, &collector, &scratches](size_t i, unsigned int thread)
 		{
-			uint8_t c = 0;
-			tree.getNodeValue(curnode, c);
-			decodedText << (char)c;
+			SBlockJob& job = batch.jobs[i];
 
+			job.bitstream.clear();
+			job.encoded = huffmanEncodeBlock(job.text, job.size, options.maxCodeLength, options.streamCount, job.bitstream, collector.blockStats(job.stats), &scratches[thread],
+				options.checkpointInterval, job.checkpoints.data(), options.level);
+		}));
 
-			curnode = root;
+		progress.update(textWritten, encodedWritten);
+
+		for (size_t i = 0; i < batch.count; i++)
+		{
+			if (!batch.jobs[i].encoded)
+				return false;
 		}
 
-		//Print decoding progress to console
-		if ((((bitstream.getRead() - initialRead) * 100) % dataSize) == 0)
+		return true;
+	};
+
+	//Write the batch in order
+	stages.write = [&](SCompressBatch& batch)
+	{
+		for (size_t i = 0; i < batch.count; i++)
 		{
-			size_t perc = ((bitstream.getRead() - initialRead) * 100) / dataSize;
+			const SBlockJob& job = batch.jobs[i];
+
+			if (!writeBlock(write, job.bitstream, job.size, offset, index))
+				return false;
 
-			cout << "\r";
-			cout << perc << "% completed (" << duration_cast<milliseconds>(high_resolution_clock::now() - t0).count() << "ms): " << string((size_t)perc / 5, '|');
-			cout.flush();
+			addCheckpoints(job.checkpoints.data(), job.size, options.checkpointInterval, textBytes, index, checkpoints);
+
+			textBytes += job.size;
+			collector.addBlock(job.stats, job.size, true);
 		}
-	}
 
-	cout << endl;
-	cout << "Decoded.\n";
+		textWritten = textBytes;
+		encodedWritten = offset;
+
+		return true;
+	};
+
+	if (!runPipeline(batches, stages) || !writeStreamEnd(write, index, checkpoints, offset))
+		return false;
+
+	progress.finish(textBytes, offset);
+	collector.finish(textBytes, offset, offset, index.size());
 
 	return true;
 }
 
+//Writes encoded text to a stream
+static EncodedWriter streamWriter(ostream& encodedText)
+{
+	return [&encodedText](const void* data, size_t size)
+	{
+		encodedText.write(reinterpret_cast<const char*>(data), size);
+		return encodedText.good();
+	};
+}
+
+//Appends encoded text to memory owned by the caller, writes which do not fit in its capacity fail
+class BufferWriter
+{
+public:
+
+	BufferWriter(uint8_t* buffer, size_t capacity) :
+		m_buffer(buffer),
+		m_capacity(capacity)
+	{}
+
+	bool operator()(const void* data, size_t size)
+	{
+		if (size > (m_capacity - m_size))
+		{
+			m_overflow = true;
+			return false;
+		}
+
+		if (size)
+			memcpy(m_buffer + m_size, data, size);
+
+		m_size += size;
+		return true;
+	}
+
+	size_t getSize() const { return m_size; }
+
+	//Returns true if a write did not fit
+	bool overflowed() const { return m_overflow; }
+
+private:
+
+	uint8_t* m_buffer;
+	size_t m_capacity;
+	size_t m_size = 0;
+	bool m_overflow = false;
+};
+
+//Supplies blocks straight from text held in memory
+static BlockReader bufferReader(const uint8_t* text, size_t textSize, size_t blockSize)
+{
+	size_t position = 0;
+
+	return [=](vector<SBlockJob>& jobs) mutable
+	{
+		for (size_t i = 0; i < jobs.size(); i++)
+		{
+			jobs[i].text = text + position;
+			jobs[i].size = min(blockSize, textSize - position);
+
+			position += jobs[i].size;
+
+			if (jobs[i].size < blockSize)
+				return (jobs[i].size == 0) ? i : (i + 1);
+		}
+
+		return jobs.size();
+	};
+}
+
+bool huffmanCompressStream(istream& text, ostream& encodedText, const SHuffmanOptions& options, SHuffmanStats* stats)
+{
+	HuffmanErrorScope errors(options.error);
+
+	StatsCollector collector(stats);
+
+	//Blocks are read into buffers of their own, as the next batch is read while the last one is encoded
+	const bool compressed = compressBlocks(streamWriter(encodedText), options, unknownTextSize, collector, [&](vector<SBlockJob>& jobs)
+	{
+		for (size_t i = 0; i < jobs.size(); i++)
+		{
+			SBlockJob& job = jobs[i];
+
+			job.buffer.resize(options.blockSize);
+			text.read(reinterpret_cast<char*>(job.buffer.data()), options.blockSize);
+
+			job.text = job.buffer.data();
+			job.size = (size_t)text.gcount();
+
+			if (job.size < options.blockSize)
+				return (job.size == 0) ? i : (i + 1);
+		}
+
+		return jobs.size();
+	}, true);
+
+	if (text.bad())
+	{
+		HuffmanError() << "Unable to read text";
+		return false;
+	}
+
+	return compressed;
+}
+
+bool huffmanCompressStream(const uint8_t* text, size_t textSize, ostream& encodedText, const SHuffmanOptions& options, SHuffmanStats* stats)
+{
+	HuffmanErrorScope errors(options.error);
+
+	StatsCollector collector(stats);
+
+	//Blocks are encoded straight from the text
+	return compressBlocks(streamWriter(encodedText), options, textSize, collector, bufferReader(text, textSize, options.blockSize), true);
+}
+
+bool huffmanCompressBuffer(const uint8_t* text, size_t textSize, uint8_t* encodedText, size_t encodedCapacity, size_t& encodedSize, const SHuffmanOptions& options, SHuffmanStats* stats)
+{
+	HuffmanErrorScope errors(options.error);
+
+	StatsCollector collector(stats);
+
+	//Blocks are copied from their bitstreams straight into the encoded text
+	BufferWriter writer(encodedText, encodedCapacity);
+
+	//Writes are copies into memory, so there is no I/O to overlap with encoding
+	const bool compressed = compressBlocks([&writer](const void* data, size_t size) { return writer(data, size); },
+		options, textSize, collector, bufferReader(text, textSize, options.blockSize), false);
+
+	encodedSize = writer.getSize();
+
+	if (!compressed && writer.overflowed())
+		HuffmanError() << "Encoded text does not fit in " << encodedCapacity << "B, see huffmanCompressBound";
+
+	return compressed;
+}
+
+size_t huffmanCompressBound(size_t textSize, const SHuffmanOptions& options)
+{
+	if (options.blockSize == 0 || options.blockSize > HUFFMAN_MAX_BLOCK_SIZE || options.streamCount == 0 || options.streamCount > HUFFMAN_MAX_STREAM_COUNT)
+		return 0;
+
+	const size_t fullBlocks = textSize / options.blockSize;
+	const size_t lastBlock = textSize % options.blockSize;
+	const size_t blockCount = fullBlocks + (lastBlock ? 1 : 0);
+
+	size_t bound = sizeof(SHuffmanStreamHeader) + sizeof(SHuffmanBlockHeader) + sizeof(SHuffmanIndexFooter);
+
+	bound += fullBlocks * (sizeof(SHuffmanBlockHeader) + huffmanBlockBound(options.blockSize, options.streamCount, options.maxCodeLength));
+	bound += lastBlock ? (sizeof(SHuffmanBlockHeader) + huffmanBlockBound(lastBlock, options.streamCount, options.maxCodeLength)) : 0;
+	bound += blockCount * sizeof(SHuffmanBlockIndexEntry);
+	bound += (size_t)checkpointCount(textSize, options.checkpointInterval) * sizeof(SHuffmanCheckpoint);
+
+	return bound;
+}
+
+size_t huffmanCompressScratchSize(size_t textSize, const SHuffmanOptions& options)
+{
+	if (options.blockSize == 0)
+		return 0;
+
+	const SCompressLayout layout = compressLayout(options, textSize);
+	const size_t blockCount = (textSize + options.blockSize - 1) / options.blockSize;
+
+	//Bit writers hold a word and a byte past the bits they reserve
+	const size_t writerPadding = sizeof(uint64_t) + 1;
+
+	//Bitstream of every block in a batch
+	size_t scratch = layout.jobCount * (huffmanBlockBound(layout.jobBlockSize, options.streamCount, options.maxCodeLength) + writerPadding);
+
+	//Interleaved bitstreams of the block being encoded on each thread
+	if (options.streamCount > 1)
+		scratch += layout.threadCount * options.streamCount * (huffmanBlockBound(layout.jobBlockSize / options.streamCount + 1, 1, options.maxCodeLength) + writerPadding);
+
+	//Bitstreams of every split of the block being encoded on each thread tried by high levels
+	if (options.level > HUFFMAN_DEFAULT_LEVEL && !options.checkpointInterval)
+	{
+		for (size_t parts = 1; parts <= HUFFMAN_MAX_SPLIT_PARTS; parts *= 2)
+			scratch += layout.threadCount * parts * (huffmanBlockBound(layout.jobBlockSize / parts + 1, options.streamCount, options.maxCodeLength) + writerPadding);
+	}
+
+	//Checkpoint bit offsets of every block in a batch
+	scratch += layout.jobCount * (size_t)checkpointCount(layout.jobBlockSize, options.checkpointInterval) * sizeof(uint32_t);
+
+	return scratch + blockCount * sizeof(SHuffmanBlockIndexEntry) + (size_t)checkpointCount(textSize, options.checkpointInterval) * sizeof(SHuffmanCheckpoint);
+}
+
+//Size of a stream header of a given version
+static size_t streamHeaderSize(uint32_t version)
+{
+	switch (version)
+	{
+	case 1: return offsetof(SHuffmanStreamHeader, streamCount);
+	case 2: return offsetof(SHuffmanStreamHeader, checkpointInterval);
+	default: return sizeof(SHuffmanStreamHeader);
+	}
+}
+
+//Checks the block size, stream count and checkpoint interval of a stream header
+static bool checkStreamHeader(const SHuffmanStreamHeader& header)
+{
+	return (header.blockSize != 0 && header.blockSize <= HUFFMAN_MAX_BLOCK_SIZE) &&
+		(header.streamCount != 0 && header.streamCount <= HUFFMAN_MAX_STREAM_COUNT) &&
+		(header.checkpointInterval == 0 || (header.streamCount == 1 && header.blockSize % header.checkpointInterval == 0));
+}
+
+//Checks that a block index describes the blocks of a stream of streamSize bytes
+//Blocks must be in order, must not overlap and must end before the end marker, and the checkpoint index must fill
+//the space between the block index and the footer
+static bool checkBlockIndex(const SHuffmanStreamHeader& header, const SHuffmanIndexFooter& footer, uint64_t streamSize, const vector<SHuffmanBlockIndexEntry>& index)
+{
+	const size_t headerSize = streamHeaderSize(header.version);
+
+	const uint64_t indexSize = (uint64_t)footer.blockCount * sizeof(SHuffmanBlockIndexEntry);
+
+	if (footer.magic != SHuffmanIndexFooter::magicValue ||
+		footer.indexOffset < (headerSize + sizeof(SHuffmanBlockHeader)) ||
+		footer.indexOffset + indexSize + sizeof(SHuffmanIndexFooter) > streamSize ||
+		index.size() != footer.blockCount)
+		return false;
+
+	uint64_t nextOffset = headerSize;
+	uint64_t textSize = 0;
+
+	for (size_t i = 0; i < index.size(); i++)
+	{
+		const SHuffmanBlockIndexEntry& entry = index[i];
+		const size_t bytecount = (entry.bitcount + CHAR_BIT - 1) / CHAR_BIT;
+
+		if (entry.size == 0 || entry.size > header.blockSize || bytecount > huffmanBlockBound(entry.size, header.streamCount) ||
+			entry.offset < nextOffset || entry.offset > footer.indexOffset)
+			return false;
+
+		//Checkpoints are found from the text offset alone, so only the last block may be short
+		if (header.checkpointInterval && (i + 1) < index.size() && entry.size != header.blockSize)
+			return false;
+
+		nextOffset = entry.offset + sizeof(SHuffmanBlockHeader) + bytecount;
+		textSize += entry.size;
+	}
+
+	const uint64_t checkpointSize = checkpointCount(textSize, header.checkpointInterval) * sizeof(SHuffmanCheckpoint);
+
+	return (nextOffset + sizeof(SHuffmanBlockHeader) <= footer.indexOffset) &&
+		(footer.indexOffset + indexSize + checkpointSize + sizeof(SHuffmanIndexFooter) == streamSize);
+}
+
+//Reads the block index from the end of a seekable block stream, streamStart is the offset of the stream header
+//Returns false if the stream cannot seek or has no valid index, the read position is left undefined
+static bool readBlockIndex(istream& encodedText, streamoff streamStart, const SHuffmanStreamHeader& header, vector<SHuffmanBlockIndexEntry>& index)
+{
+	encodedText.seekg(0, ios::end);
+	const streamoff streamEnd = encodedText.tellg();
+
+	const size_t headerSize = streamHeaderSize(header.version);
+
+	if (!encodedText.good() || streamEnd < (streamoff)(streamStart + headerSize + sizeof(SHuffmanIndexFooter)))
+		return false;
+
+	const uint64_t streamSize = (uint64_t)(streamEnd - streamStart);
+
+	SHuffmanIndexFooter footer;
+	encodedText.seekg(streamEnd - (streamoff)sizeof(SHuffmanIndexFooter));
+	encodedText.read(reinterpret_cast<char*>(&footer), sizeof(SHuffmanIndexFooter));
+
+	//Index entries follow the end marker, checkpoints may follow the index
+	const uint64_t indexSize = (uint64_t)footer.blockCount * sizeof(SHuffmanBlockIndexEntry);
+
+	if (!encodedText.good() || footer.magic != SHuffmanIndexFooter::magicValue ||
+		footer.indexOffset > streamSize || indexSize > (streamSize - footer.indexOffset))
+		return false;
+
+	index.resize(footer.blockCount);
+	encodedText.seekg(streamStart + (streamoff)footer.indexOffset);
+	encodedText.read(reinterpret_cast<char*>(index.data()), indexSize);
+
+	return encodedText.good() && checkBlockIndex(header, footer, streamSize, index);
+}
+
+//Decodes a block listed in a block index, block points to the block header
+static bool decodeIndexedBlock(const uint8_t* block, const SHuffmanBlockIndexEntry& entry, unsigned int streamCount, uint8_t* text, SHuffmanBlockStats* stats,
+	SHuffmanBlockScratch* scratch = nullptr)
+{
+	//Block header must agree with the index
+	SHuffmanBlockHeader blockHeader;
+	memcpy(&blockHeader, block, sizeof(SHuffmanBlockHeader));
+
+	if (blockHeader.size != entry.size || blockHeader.bitcount != entry.bitcount)
+	{
+		HuffmanError() << "Block index does not match block at offset " << entry.offset;
+		return false;
+	}
+
+	BitReader bitstream(block + sizeof(SHuffmanBlockHeader), entry.bitcount);
+
+	return huffmanDecodeBlock(bitstream, text, entry.size, streamCount, stats, scratch);
+}
+
+//A batch of blocks moving through the decompression pipeline, each block is read along with its block header
+struct SDecompressBatch
+{
+	vector<SHuffmanBlockIndexEntry> entries;	//Blocks of the batch, offsets are from the start of the stream
+	size_t count = 0;							//Number of entries holding a block
+	uint64_t encodedStart = 0;					//Offset of the first block of the batch
+	vector<uint8_t> encoded;					//Blocks of the batch as they are in the stream
+	vector<uint8_t> text;
+	vector<size_t> textOffsets;
+	vector<SHuffmanBlockStats> stats;
+	vector<uint8_t> decoded;
+};
+
+//Fills a batch with the next blocks of a stream, last is set once the stream is finished
+typedef function<bool(SDecompressBatch& batch, bool& last)> BatchReader;
+
+//Decodes the batches filled by readBatch on the threads of a pool, each block straight into its place in the batch text,
+//and writes their text in order, textBytes is set to the number of characters written
+//Batches are read and written on threads of their own while the previous batch is decoded, unless options.pipeline is cleared
+static bool decodeBatches(const BatchReader& readBatch, ostream& decodedText, const SHuffmanStreamHeader& header, const SHuffmanOptions& options,
+	ThreadPool& pool, ProgressReporter& progress, StatsCollector& collector, uint64_t& textBytes)
+{
+	const size_t batchSize = pool.getThreadCount() * 2;
+
+	vector<SDecompressBatch> batches(options.pipeline ? pipelineBatchCount : 1);
+
+	for (SDecompressBatch& batch : batches)
+	{
+		batch.entries.resize(batchSize);
+		batch.textOffsets.resize(batchSize);
+		batch.stats.resize(batchSize);
+		batch.decoded.resize(batchSize);
+	}
+
+	//Bytes written so far, published by the writer for progress reports made on the calling thread
+	textBytes = 0;
+	atomic<uint64_t> textWritten(0);
+	atomic<uint64_t> encodedWritten(0);
+
+	SPipelineStages<SDecompressBatch> stages;
+	stages.read = readBatch;
+
+	stages.process = [&](SDecompressBatch& batch)
+	{
+		//Size the text of the batch from the block headers and find where each block is decoded to
+		size_t textSize = 0;
+
+		for (size_t i = 0; i < batch.count; i++)
+		{
+			batch.textOffsets[i] = textSize;
+			textSize += batch.entries[i].size;
+		}
+
+		batch.text.resize(textSize);
+
+		pool.parallelFor(batch.count, [&batch, &header, &collector](size_t i)
+		{
+			const SHuffmanBlockIndexEntry& entry = batch.entries[i];
+			const uint8_t* block = batch.encoded.data() + (size_t)(entry.offset - batch.encodedStart);
+
+			batch.decoded[i] = decodeIndexedBlock(block, entry, header.streamCount, batch.text.data() + batch.textOffsets[i], collector.blockStats(batch.stats[i]));
+		});
+
+		progress.update(textWritten, encodedWritten);
+
+		for (size_t i = 0; i < batch.count; i++)
+		{
+			if (!batch.decoded[i])
+				return false;
+		}
+
+		return true;
+	};
+
+	stages.write = [&](SDecompressBatch& batch)
+	{
+		for (size_t i = 0; i < batch.count; i++)
+			collector.addBlock(batch.stats[i], batch.entries[i].size, false);
+
+		decodedText.write(reinterpret_cast<const char*>(batch.text.data()), batch.text.size());
+
+		if (!decodedText.good())
+		{
+			HuffmanError() << "Unable to write decoded text";
+			return false;
+		}
+
+		textBytes += batch.text.size();
+		textWritten = textBytes;
+		encodedWritten = batch.encodedStart + batch.encoded.size();
+
+		return true;
+	};
+
+	return runPipeline(batches, stages);
+}
+
+//Reads the blocks listed in a block index, each batch of blocks is read with a single read
+static BatchReader indexedBatchReader(istream& encodedText, streamoff streamStart, const vector<SHuffmanBlockIndexEntry>& index)
+{
+	size_t first = 0;
+
+	return [&encodedText, streamStart, &index, first](SDecompressBatch& batch, bool& last) mutable
+	{
+		batch.count = min(batch.entries.size(), index.size() - first);
+		copy(index.begin() + first, index.begin() + first + batch.count, batch.entries.begin());
+
+		first += batch.count;
+		last = (first == index.size());
+
+		batch.encoded.clear();
+
+		if (batch.count == 0)
+			return true;
+
+		const SHuffmanBlockIndexEntry& lastEntry = batch.entries[batch.count - 1];
+		const uint64_t batchEnd = lastEntry.offset + sizeof(SHuffmanBlockHeader) + (lastEntry.bitcount + CHAR_BIT - 1) / CHAR_BIT;
+
+		batch.encodedStart = batch.entries[0].offset;
+		batch.encoded.resize((size_t)(batchEnd - batch.encodedStart));
+
+		encodedText.seekg(streamStart + (streamoff)batch.encodedStart);
+		encodedText.read(reinterpret_cast<char*>(batch.encoded.data()), batch.encoded.size());
+
+		if (!encodedText.good())
+		{
+			HuffmanError() << "Unexpected end of stream";
+			return false;
+		}
+
+		return true;
+	};
+}
+
+//Reads blocks in order from the read position of a stream up to its end marker, encodedBytes is the offset of the read position
+//and is moved past every block read
+static BatchReader sequentialBatchReader(istream& encodedText, const SHuffmanStreamHeader& header, uint64_t& encodedBytes)
+{
+	return [&encodedText, &header, &encodedBytes](SDecompressBatch& batch, bool& last)
+	{
+		batch.count = 0;
+		batch.encodedStart = encodedBytes;
+		batch.encoded.clear();
+
+		last = false;
+
+		while (batch.count < batch.entries.size())
+		{
+			SHuffmanBlockHeader blockHeader;
+			encodedText.read(reinterpret_cast<char*>(&blockHeader), sizeof(SHuffmanBlockHeader));
+
+			if (!encodedText.good())
+			{
+				HuffmanError() << "Unexpected end of stream";
+				return false;
+			}
+
+			if (blockHeader.size == 0)
+			{
+				encodedBytes += sizeof(SHuffmanBlockHeader);
+				last = true;
+				break;
+			}
+
+			const size_t bytecount = (blockHeader.bitcount + CHAR_BIT - 1) / CHAR_BIT;
+
+			if (blockHeader.size > header.blockSize || bytecount > huffmanBlockBound(blockHeader.size, header.streamCount))
+			{
+				HuffmanError() << "Invalid block header";
+				return false;
+			}
+
+			SHuffmanBlockIndexEntry& entry = batch.entries[batch.count];
+			entry.offset = encodedBytes;
+			entry.size = blockHeader.size;
+			entry.bitcount = blockHeader.bitcount;
+
+			//Block header is kept in front of its bitstream, as blocks listed in an index are read
+			const size_t position = batch.encoded.size();
+			batch.encoded.resize(position + sizeof(SHuffmanBlockHeader) + bytecount);
+
+			memcpy(batch.encoded.data() + position, &blockHeader, sizeof(SHuffmanBlockHeader));
+			encodedText.read(reinterpret_cast<char*>(batch.encoded.data() + position + sizeof(SHuffmanBlockHeader)), bytecount);
+
+			if (!encodedText.good())
+			{
+				HuffmanError() << "Unexpected end of stream";
+				return false;
+			}
+
+			encodedBytes += sizeof(SHuffmanBlockHeader) + bytecount;
+			batch.count++;
+		}
+
+		return true;
+	};
+}
+
+//Decompresses a block stream, the magic value has already been read
+static bool decompressBlocks(istream& encodedText, ostream& decodedText, const SHuffmanOptions& options, StatsCollector& collector)
+{
+	SHuffmanStreamHeader header;
+
+	//Version is read first as it decides the size of the rest of the header
+	encodedText.read(reinterpret_cast<char*>(&header.version), sizeof(header.version));
+
+	if (!encodedText.good() || header.version == 0 || header.version > SHuffmanStreamHeader::currentVersion)
+	{
+		HuffmanError() << "Unsupported stream header";
+		return false;
+	}
+
+	const size_t headerSize = streamHeaderSize(header.version);
+	const size_t headerRead = sizeof(header.magic) + sizeof(header.version);
+
+	encodedText.read(reinterpret_cast<char*>(&header) + headerRead, headerSize - headerRead);
+
+	if (!encodedText.good())
+	{
+		HuffmanError() << "Unable to read stream header";
+		return false;
+	}
+
+	if (!checkStreamHeader(header))
+	{
+		HuffmanError() << "Invalid stream header";
+		return false;
+	}
+
+	ThreadPool pool(options.threadCount);
+
+	//Blocks are read with a single read per batch when the stream can seek to its index, otherwise they are read in order
+	if (options.threadCount != 1)
+	{
+		const streamoff blocksStart = encodedText.tellg();
+
+		if (blocksStart >= (streamoff)headerSize)
+		{
+			const streamoff streamStart = blocksStart - (streamoff)headerSize;
+			vector<SHuffmanBlockIndexEntry> index;
+
+			if (readBlockIndex(encodedText, streamStart, header, index))
+			{
+				uint64_t textTotal = 0;
+
+				for (const SHuffmanBlockIndexEntry& entry : index)
+					textTotal += entry.size;
+
+				ProgressReporter progress(options, textTotal, 0);
+				uint64_t textBytes = 0;
+
+				if (!decodeBatches(indexedBatchReader(encodedText, streamStart, index), decodedText, header, options, pool, progress, collector, textBytes))
+					return false;
+
+				//Whole stream including its index was read
+				encodedText.seekg(0, ios::end);
+				const uint64_t encodedBytes = (uint64_t)(encodedText.tellg() - streamStart);
+
+				progress.finish(textTotal, encodedBytes);
+				collector.finish(encodedBytes, textTotal, encodedBytes, index.size());
+				return true;
+			}
+
+			//Streams without an index are read in order from the first block
+			encodedText.clear();
+			encodedText.seekg(blocksStart);
+		}
+	}
+
+	//Only the batches of the ring are held in memory
+	ProgressReporter progress(options, 0, 0);
+	uint64_t textBytes = 0;
+	uint64_t encodedBytes = headerSize;
+	uint64_t blockCount = 0;
+
+	const BatchReader readBatch = sequentialBatchReader(encodedText, header, encodedBytes);
+
+	//Blocks are counted as they are read
+	const bool decompressed = decodeBatches([&readBatch, &blockCount](SDecompressBatch& batch, bool& last)
+	{
+		const bool read = readBatch(batch, last);
+		blockCount += batch.count;
+		return read;
+	}, decodedText, header, options, pool, progress, collector, textBytes);
+
+	if (!decompressed)
+		return false;
+
+	progress.finish(textBytes, encodedBytes);
+	collector.finish(encodedBytes, textBytes, encodedBytes, blockCount);
+
+	return true;
+}
+
+//Reads the stream header and block index of a block stream held in memory
+static bool readBlockIndex(const uint8_t* encodedText, size_t encodedSize, SHuffmanStreamHeader& header, vector<SHuffmanBlockIndexEntry>& index)
+{
+	if (encodedSize < (offsetof(SHuffmanStreamHeader, streamCount) + sizeof(SHuffmanIndexFooter)))
+		return false;
+
+	memcpy(reinterpret_cast<char*>(&header), encodedText, offsetof(SHuffmanStreamHeader, streamCount));
+
+	if (header.magic != SHuffmanStreamHeader::magicValue || header.version == 0 || header.version > SHuffmanStreamHeader::currentVersion)
+		return false;
+
+	const size_t headerSize = streamHeaderSize(header.version);
+
+	if (encodedSize < (headerSize + sizeof(SHuffmanIndexFooter)))
+		return false;
+
+	memcpy(reinterpret_cast<char*>(&header), encodedText, headerSize);
+
+	if (!checkStreamHeader(header))
+		return false;
+
+	SHuffmanIndexFooter footer;
+	memcpy(&footer, encodedText + encodedSize - sizeof(SHuffmanIndexFooter), sizeof(SHuffmanIndexFooter));
+
+	const uint64_t indexSize = (uint64_t)footer.blockCount * sizeof(SHuffmanBlockIndexEntry);
+
+	if (footer.magic != SHuffmanIndexFooter::magicValue ||
+		footer.indexOffset > encodedSize || indexSize > (encodedSize - footer.indexOffset))
+		return false;
+
+	index.resize(footer.blockCount);
+
+	if (indexSize)
+		memcpy(index.data(), encodedText + footer.indexOffset, (size_t)indexSize);
+
+	return checkBlockIndex(header, footer, encodedSize, index);
+}
+
+//Reads the header of single buffer encoded text held in memory, returns false if it has no versioned header or is truncated
+static bool readTextHeader(const uint8_t* encodedText, size_t encodedSize, SHuffmanTextHeader& header)
+{
+	if (encodedSize < sizeof(SHuffmanTextHeader))
+		return false;
+
+	memcpy(&header, encodedText, sizeof(SHuffmanTextHeader));
+
+	return header.magic == SHuffmanTextHeader::magicValue &&
+		header.version != 0 && header.version <= SHuffmanTextHeader::currentVersion &&
+		(header.bitcount + CHAR_BIT - 1) / CHAR_BIT <= encodedSize - sizeof(SHuffmanTextHeader);
+}
+
+//Decodes single buffer encoded text with a versioned header straight into text, which must hold header.textSize characters
+static bool decodeSingleBuffer(const uint8_t* encodedText, const SHuffmanTextHeader& header, uint8_t* text, StatsCollector& collector)
+{
+	//Empty text is stored as a header alone without a code table
+	if (header.textSize == 0 && header.bitcount == 0)
+	{
+		collector.finish(sizeof(SHuffmanTextHeader), 0, sizeof(SHuffmanTextHeader), 0);
+		return true;
+	}
+
+	SHuffmanBlockStats block;
+	steady_clock::time_point start;
+
+	if (collector.enabled())
+		start = steady_clock::now();
+
+	BitReader bitstream(encodedText + sizeof(SHuffmanTextHeader), (size_t)header.bitcount);
+	HuffmanCodeTable codeTable;
+	HuffmanDecodeTable decodeTable;
+
+	if (!readSingleBufferTable(bitstream, codeTable))
+		return false;
+
+	if (!decodeTable.build(codeTable))
+	{
+		HuffmanError() << "Unable to build decoding table";
+		return false;
+	}
+
+	const size_t tableBits = bitstream.getRead();
+
+	if (collector.enabled())
+	{
+		block.tableTime = duration<double>(steady_clock::now() - start).count();
+		start = steady_clock::now();
+	}
+
+	if (!huffmanDecodeCharacters(decodeTable, bitstream, text, (size_t)header.textSize))
+		return false;
+
+	if (bitstream.getRead() != header.bitcount)
+	{
+		HuffmanError() << "Encoded text holds more than " << header.textSize << " characters";
+		return false;
+	}
+
+	if (collector.enabled())
+	{
+		block.codingTime = duration<double>(steady_clock::now() - start).count();
+		block.payloadBits = header.bitcount - tableBits;
+
+		start = steady_clock::now();
+
+		uint64_t counts[HuffmanCodeTable::size] = {};
+		huffmanHistogramAdd(text, (size_t)header.textSize, counts);
+
+		block.histogramTime = duration<double>(steady_clock::now() - start).count();
+
+		for (size_t ch = 0; ch < HuffmanCodeTable::size; ch++)
+		{
+			if (counts[ch])
+				block.maxCodeLength = max(block.maxCodeLength, codeTable[(uint8_t)ch].length);
+		}
+
+		collector.addCounts(counts);
+
+		const uint64_t encodedBytes = sizeof(SHuffmanTextHeader) + (header.bitcount + CHAR_BIT - 1) / CHAR_BIT;
+
+		collector.addBlock(block, header.textSize, false);
+		collector.finish(encodedBytes, header.textSize, encodedBytes, 0);
+	}
+
+	return true;
+}
+
+bool huffmanDecompressedSize(const uint8_t* encodedText, size_t encodedSize, uint64_t& textSize)
+{
+	SHuffmanTextHeader textHeader;
+
+	//Single buffer encoded text holds the size of the text in its header
+	if (readTextHeader(encodedText, encodedSize, textHeader))
+	{
+		textSize = textHeader.textSize;
+		return true;
+	}
+
+	SHuffmanStreamHeader header;
+	vector<SHuffmanBlockIndexEntry> index;
+
+	if (!readBlockIndex(encodedText, encodedSize, header, index))
+		return false;
+
+	textSize = 0;
+
+	for (const SHuffmanBlockIndexEntry& entry : index)
+		textSize += entry.size;
+
+	return true;
+}
+
+bool huffmanDecompressBuffer(const uint8_t* encodedText, size_t encodedSize, uint8_t* text, size_t textCapacity, size_t& textSize, const SHuffmanOptions& options, SHuffmanStats* stats)
+{
+	HuffmanErrorScope errors(options.error);
+
+	StatsCollector collector(stats);
+
+	SHuffmanTextHeader textHeader;
+
+	if (readTextHeader(encodedText, encodedSize, textHeader))
+	{
+		if (textHeader.textSize > textCapacity)
+		{
+			HuffmanError() << "Decoded text does not fit in " << textCapacity << "B, see huffmanDecompressedSize";
+			return false;
+		}
+
+		ProgressReporter progress(options, textHeader.textSize, encodedSize);
+
+		if (!decodeSingleBuffer(encodedText, textHeader, text, collector))
+			return false;
+
+		textSize = (size_t)textHeader.textSize;
+		progress.finish(textSize, encodedSize);
+
+		return true;
+	}
+
+	SHuffmanStreamHeader header;
+	vector<SHuffmanBlockIndexEntry> index;
+
+	if (!readBlockIndex(encodedText, encodedSize, header, index))
+	{
+		HuffmanError() << "Encoded text is not a block stream with a valid block index or single buffer encoded text with a versioned header";
+		return false;
+	}
+
+	//Find where each block is decoded to
+	vector<size_t> textOffsets(index.size());
+	uint64_t offset = 0;
+
+	for (size_t i = 0; i < index.size(); i++)
+	{
+		textOffsets[i] = (size_t)offset;
+		offset += index[i].size;
+	}
+
+	if (offset > textCapacity)
+	{
+		HuffmanError() << "Decoded text does not fit in " << textCapacity << "B, see huffmanDecompressedSize";
+		return false;
+	}
+
+	textSize = (size_t)offset;
+
+	//Every block is decoded straight from the encoded text into its place in the text
+	ThreadPool pool(options.threadCount);
+	vector<uint8_t> decoded(index.size());
+	vector<SHuffmanBlockStats> blockStats(collector.enabled() ? index.size() : 0);
+
+	ProgressReporter progress(options, textSize, encodedSize);
+
+	//All blocks are decoded at once unless progress is reported between batches of blocks
+	const size_t batchSize = progress.enabled() ? pool.getThreadCount() * 4 : max<size_t>(index.size(), 1);
+
+	for (size_t first = 0; first < index.size(); first += batchSize)
+	{
+		const size_t count = min(batchSize, index.size() - first);
+
+		pool.parallelFor(count, [&](size_t i)
+		{
+			const size_t block = first + i;
+			decoded[block] = decodeIndexedBlock(encodedText + index[block].offset, index[block], header.streamCount, text + textOffsets[block],
+				collector.enabled() ? &blockStats[block] : nullptr);
+		});
+
+		const SHuffmanBlockIndexEntry& last = index[first + count - 1];
+		progress.update(textOffsets[first + count - 1] + last.size, last.offset + sizeof(SHuffmanBlockHeader) + (last.bitcount + CHAR_BIT - 1) / CHAR_BIT);
+	}
+
+	for (uint8_t blockDecoded : decoded)
+	{
+		if (!blockDecoded)
+			return false;
+	}
+
+	for (size_t i = 0; i < blockStats.size(); i++)
+		collector.addBlock(blockStats[i], index[i].size, false);
+
+	progress.finish(textSize, encodedSize);
+	collector.finish(encodedSize, textSize, encodedSize, index.size());
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//Returns size bytes of encoded text from offset, or null if they cannot be read
+//The bytes stay valid until the next call
+typedef function<const uint8_t*(uint64_t offset, size_t size)> EncodedFetcher;
+
+//Writes decoded text, returns false if it cannot be written
+typedef function<bool(const uint8_t* text, size_t size)> TextWriter;
+
+//Reads a value of encoded text from offset
+template<typename T>
+static bool fetchValue(const EncodedFetcher& fetch, uint64_t offset, T& value)
+{
+	const uint8_t* data = fetch(offset, sizeof(T));
+
+	if (data)
+		memcpy(&value, data, sizeof(T));
+
+	return data != nullptr;
+}
+
+//Reads the stream header and footer of a block stream of encodedSize bytes
+static bool fetchStreamEnds(const EncodedFetcher& fetch, uint64_t encodedSize, SHuffmanStreamHeader& header, SHuffmanIndexFooter& footer)
+{
+	if (!fetchValue(fetch, 0, header.magic) || header.magic != SHuffmanStreamHeader::magicValue)
+	{
+		HuffmanError() << "Ranges can only be decoded from block streams";
+		return false;
+	}
+
+	//Version decides the size of the rest of the header
+	const uint8_t* data = fetch(0, offsetof(SHuffmanStreamHeader, streamCount));
+
+	if (data)
+		memcpy(reinterpret_cast<char*>(&header), data, offsetof(SHuffmanStreamHeader, streamCount));
+
+	const size_t headerSize = streamHeaderSize(header.version);
+
+	if (data && header.version != 0 && header.version <= SHuffmanStreamHeader::currentVersion)
+		data = fetch(0, headerSize);
+	else
+		data = nullptr;
+
+	if (data)
+		memcpy(reinterpret_cast<char*>(&header), data, headerSize);
+
+	if (!data || !checkStreamHeader(header) || encodedSize < headerSize + sizeof(SHuffmanIndexFooter) ||
+		!fetchValue(fetch, encodedSize - sizeof(SHuffmanIndexFooter), footer) || footer.magic != SHuffmanIndexFooter::magicValue ||
+		footer.indexOffset > encodedSize || (uint64_t)footer.blockCount * sizeof(SHuffmanBlockIndexEntry) > (encodedSize - footer.indexOffset))
+	{
+		HuffmanError() << "Encoded text is not a block stream with a valid block index";
+		return false;
+	}
+
+	return true;
+}
+
+//Decodes characters [start, end) of a stream with checkpoints, each block holding part of the range is decoded from
+//the checkpoint before the range, only the checkpoints and index entries of those blocks are read
+static bool decodeCheckpointRange(const EncodedFetcher& fetch, uint64_t encodedSize, const SHuffmanStreamHeader& header, const SHuffmanIndexFooter& footer,
+	uint64_t start, uint64_t end, const TextWriter& write, uint64_t& textSize)
+{
+	const uint64_t checkpointsOffset = footer.indexOffset + (uint64_t)footer.blockCount * sizeof(SHuffmanBlockIndexEntry);
+	const uint64_t checkpointsEnd = encodedSize - sizeof(SHuffmanIndexFooter);
+
+	//Every block but the last is full, so the size of the text is found from the last entry of the index
+	SHuffmanBlockIndexEntry lastEntry;
+	uint64_t textTotal = 0;
+
+	if (footer.blockCount)
+	{
+		if (checkpointsOffset > checkpointsEnd || !fetchValue(fetch, checkpointsOffset - sizeof(SHuffmanBlockIndexEntry), lastEntry) ||
+			lastEntry.size == 0 || lastEntry.size > header.blockSize)
+		{
+			HuffmanError() << "Invalid block index";
+			return false;
+		}
+
+		textTotal = (uint64_t)(footer.blockCount - 1) * header.blockSize + lastEntry.size;
+	}
+
+	if (checkpointsOffset + checkpointCount(textTotal, header.checkpointInterval) * sizeof(SHuffmanCheckpoint) != checkpointsEnd)
+	{
+		HuffmanError() << "Checkpoint index does not match the block index";
+		return false;
+	}
+
+	end = min(end, textTotal);
+
+	vector<uint8_t> text;
+	SHuffmanBlockScratch scratch;
+
+	for (uint64_t position = start; position < end;)
+	{
+		const uint64_t k = position / header.checkpointInterval;
+
+		SHuffmanCheckpoint checkpoint;
+		SHuffmanBlockIndexEntry entry;
+
+		if (!fetchValue(fetch, checkpointsOffset + k * sizeof(SHuffmanCheckpoint), checkpoint) ||
+			checkpoint.textOffset != k * header.checkpointInterval || checkpoint.block != checkpoint.textOffset / header.blockSize ||
+			checkpoint.block >= footer.blockCount ||
+			!fetchValue(fetch, footer.indexOffset + (uint64_t)checkpoint.block * sizeof(SHuffmanBlockIndexEntry), entry) ||
+			entry.size == 0 || entry.size > header.blockSize || checkpoint.bitOffset > entry.bitcount ||
+			entry.offset > footer.indexOffset || (entry.bitcount + CHAR_BIT - 1) / CHAR_BIT > huffmanBlockBound(entry.size, header.streamCount))
+		{
+			HuffmanError() << "Invalid checkpoint " << k;
+			return false;
+		}
+
+		//Characters are decoded from the checkpoint to the end of the range or of the block
+		const uint64_t blockStart = (uint64_t)checkpoint.block * header.blockSize;
+		const uint64_t decodeEnd = min(end, blockStart + entry.size);
+		const size_t count = (size_t)(decodeEnd - checkpoint.textOffset);
+
+		//Only the code table and the codes before the end of the range are read
+		const uint64_t bitcount = min<uint64_t>(entry.bitcount, checkpoint.bitOffset + (uint64_t)count * HuffmanCodeTable::maxCodeLength);
+		const uint8_t* block = fetch(entry.offset, sizeof(SHuffmanBlockHeader) + (size_t)((bitcount + CHAR_BIT - 1) / CHAR_BIT));
+
+		SHuffmanBlockHeader blockHeader;
+
+		if (block)
+			memcpy(&blockHeader, block, sizeof(SHuffmanBlockHeader));
+
+		if (!block || blockHeader.size != entry.size || blockHeader.bitcount != entry.bitcount)
+		{
+			HuffmanError() << "Block index does not match block at offset " << entry.offset;
+			return false;
+		}
+
+		BitReader bitstream(block + sizeof(SHuffmanBlockHeader), (size_t)bitcount);
+		text.resize(count);
+
+		if (!huffmanDecodeBlockFrom(bitstream, checkpoint.bitOffset, text.data(), count, &scratch) ||
+			!write(text.data() + (position - checkpoint.textOffset), (size_t)(decodeEnd - position)))
+			return false;
+
+		textSize += decodeEnd - position;
+		position = decodeEnd;
+	}
+
+	return true;
+}
+
+//Decodes characters [start, end) of a stream without checkpoints, every block holding part of the range is decoded whole
+static bool decodeIndexedRange(const EncodedFetcher& fetch, uint64_t encodedSize, const SHuffmanStreamHeader& header, const SHuffmanIndexFooter& footer,
+	uint64_t start, uint64_t end, const TextWriter& write, uint64_t& textSize)
+{
+	vector<SHuffmanBlockIndexEntry> index(footer.blockCount);
+	const uint8_t* data = fetch(footer.indexOffset, index.size() * sizeof(SHuffmanBlockIndexEntry));
+
+	if (data && !index.empty())
+		memcpy(index.data(), data, index.size() * sizeof(SHuffmanBlockIndexEntry));
+
+	if (!data || !checkBlockIndex(header, footer, encodedSize, index))
+	{
+		HuffmanError() << "Encoded text is not a block stream with a valid block index";
+		return false;
+	}
+
+	vector<uint8_t> text;
+	SHuffmanBlockScratch scratch;
+	uint64_t blockStart = 0;
+
+	for (const SHuffmanBlockIndexEntry& entry : index)
+	{
+		const uint64_t blockEnd = blockStart + entry.size;
+		const uint64_t first = max(start, blockStart);
+		const uint64_t last = min(end, blockEnd);
+
+		if (first < last)
+		{
+			const uint8_t* block = fetch(entry.offset, sizeof(SHuffmanBlockHeader) + (entry.bitcount + CHAR_BIT - 1) / CHAR_BIT);
+			text.resize(entry.size);
+
+			if (!block || !decodeIndexedBlock(block, entry, header.streamCount, text.data(), nullptr, &scratch) ||
+				!write(text.data() + (first - blockStart), (size_t)(last - first)))
+				return false;
+
+			textSize += last - first;
+		}
+
+		blockStart = blockEnd;
+	}
+
+	return true;
+}
+
+//Decodes length characters from start of a block stream of encodedSize bytes, textSize is set to the number of characters written
+static bool decompressRange(const EncodedFetcher& fetch, uint64_t encodedSize, uint64_t start, uint64_t length, const TextWriter& write, uint64_t& textSize)
+{
+	textSize = 0;
+
+	SHuffmanStreamHeader header;
+	SHuffmanIndexFooter footer;
+
+	if (!fetchStreamEnds(fetch, encodedSize, header, footer))
+		return false;
+
+	const uint64_t end = start + min(length, UINT64_MAX - start);
+
+	if (header.checkpointInterval)
+		return decodeCheckpointRange(fetch, encodedSize, header, footer, start, end, write, textSize);
+
+	return decodeIndexedRange(fetch, encodedSize, header, footer, start, end, write, textSize);
+}
+
+bool huffmanDecompressRange(const uint8_t* encodedText, size_t encodedSize, uint64_t start, size_t length, uint8_t* text, size_t& textSize)
+{
+	//Encoded text is read in place
+	const EncodedFetcher fetch = [encodedText, encodedSize](uint64_t offset, size_t size) -> const uint8_t*
+	{
+		return (offset <= encodedSize && size <= encodedSize - offset) ? encodedText + offset : nullptr;
+	};
+
+	size_t position = 0;
+
+	const TextWriter write = [text, &position](const uint8_t* data, size_t size)
+	{
+		memcpy(text + position, data, size);
+		position += size;
+		return true;
+	};
+
+	uint64_t decoded = 0;
+	const bool succeeded = decompressRange(fetch, encodedSize, start, length, write, decoded);
+
+	textSize = position;
+
+	return succeeded;
+}
+
+bool huffmanDecompressRange(istream& encodedText, ostream& text, uint64_t start, uint64_t length)
+{
+	const streamoff streamStart = encodedText.tellg();
+
+	encodedText.seekg(0, ios::end);
+	const streamoff streamEnd = encodedText.tellg();
+
+	if (streamStart < 0 || streamEnd < streamStart || !encodedText.good())
+	{
+		HuffmanError() << "Ranges can only be decoded from seekable streams";
+		return false;
+	}
+
+	const uint64_t encodedSize = (uint64_t)(streamEnd - streamStart);
+
+	//Each part of the encoded text needed is read with a single read into the same buffer
+	vector<uint8_t> buffer;
+
+	const EncodedFetcher fetch = [&encodedText, &buffer, streamStart, encodedSize](uint64_t offset, size_t size) -> const uint8_t*
+	{
+		if (offset > encodedSize || size > encodedSize - offset)
+			return nullptr;
+
+		buffer.resize(max<size_t>(size, 1));
+		encodedText.seekg(streamStart + (streamoff)offset);
+		encodedText.read(reinterpret_cast<char*>(buffer.data()), size);
+
+		return encodedText.good() ? buffer.data() : nullptr;
+	};
+
+	const TextWriter write = [&text](const uint8_t* data, size_t size)
+	{
+		text.write(reinterpret_cast<const char*>(data), size);
+
+		if (!text.good())
+		{
+			HuffmanError() << "Unable to write decoded text";
+			return false;
+		}
+
+		return true;
+	};
+
+	uint64_t textSize = 0;
+
+	return decompressRange(fetch, encodedSize, start, length, write, textSize);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool huffmanDecompress(istream& encodedText, ostream& decodedText, const SHuffmanOptions& options, SHuffmanStats* stats)
+{
+	HuffmanErrorScope errors(options.error);
+
+	StatsCollector collector(stats);
+
+	//Read data header
+	SHuffmanTreeHeader header;
+
+	encodedText.read(reinterpret_cast<char*>(&header), sizeof(SHuffmanTreeHeader));
+
+	if (!encodedText.good())
+	{
+		HuffmanError() << "Unable to read header";
+		return false;
+	}
+
+	//Block streams start with a magic value in place of the bitcount
+	if (header.bitcount == SHuffmanStreamHeader::magicValue)
+		return decompressBlocks(encodedText, decodedText, options, collector);
+
+	//Versioned headers hold 64 bit sizes and the size of the text, older headers only a 32 bit bitcount
+	uint64_t bitcount = header.bitcount;
+	uint64_t textTotal = unknownTextSize;
+	size_t headerSize = sizeof(SHuffmanTreeHeader);
+
+	if (header.bitcount == SHuffmanTextHeader::magicValue)
+	{
+		SHuffmanTextHeader textHeader;
+		encodedText.read(reinterpret_cast<char*>(&textHeader) + sizeof(textHeader.magic), sizeof(SHuffmanTextHeader) - sizeof(textHeader.magic));
+
+		if (!encodedText.good() || textHeader.version == 0 || textHeader.version > SHuffmanTextHeader::currentVersion || textHeader.bitcount > SIZE_MAX)
+		{
+			HuffmanError() << "Unsupported header";
+			return false;
+		}
+
+		bitcount = textHeader.bitcount;
+		textTotal = textHeader.textSize;
+		headerSize = sizeof(SHuffmanTextHeader);
+	}
+
+	//Empty text is stored as a header alone without a code table
+	if (bitcount == 0 && (textTotal == 0 || textTotal == unknownTextSize))
+	{
+		collector.finish(headerSize, 0, headerSize, 0);
+		return true;
+	}
+
+	const size_t bytecount = (size_t)((bitcount + CHAR_BIT - 1) / CHAR_BIT);
+
+	vector<BitReader::byte_t> tempBitBuffer(bytecount);
+	encodedText.read(reinterpret_cast<char*>(tempBitBuffer.data()), bytecount);
+
+	if (!encodedText.good())
+	{
+		HuffmanError() << "Unable to read encoded text";
+		return false;
+	}
+
+	//Create encoded text bitstream
+	BitReader bitstream(tempBitBuffer.data(), (size_t)bitcount);
+
+	SHuffmanBlockStats block;
+	steady_clock::time_point start;
+
+	if (collector.enabled())
+		start = steady_clock::now();
+
+	HuffmanCodeTable codeTable;
+
+	if (!readSingleBufferTable(bitstream, codeTable))
+		return false;
+
+	//Lookup table for decoding whole characters at a time
+	HuffmanDecodeTable decodeTable;
+
+	if (!decodeTable.build(codeTable))
+	{
+		HuffmanError() << "Unable to build decoding table";
+		return false;
+	}
+
+	const size_t tableBits = bitstream.getRead();
+
+	if (collector.enabled())
+	{
+		block.tableTime = duration<double>(steady_clock::now() - start).count();
+		start = steady_clock::now();
+	}
+
+	//Progress is reported as each block of output is written
+	ProgressReporter progress(options, (textTotal != unknownTextSize) ? textTotal : 0, headerSize + bytecount);
+	uint64_t textBytes = 0;
+
+	//Characters are counted for the statistics as each block of output is written, in 64 bits as the text may be 4GB or more
+	uint64_t textCounts[HuffmanCodeTable::size] = {};
+
+	auto countOutput = [&](const uint8_t* output, size_t size)
+	{
+		const steady_clock::time_point countStart = steady_clock::now();
+
+		huffmanHistogramAdd(output, size, textCounts);
+
+		block.histogramTime += duration<double>(steady_clock::now() - countStart).count();
+	};
+
+	//Decoded characters are collected and written in blocks instead of one at a time
+	const size_t outputBlockSize = 64 * 1024;
+
+	if (textTotal != unknownTextSize)
+	{
+		//Size of the text is known, so each block of output is decoded whole into a buffer allocated once
+		vector<uint8_t> outputBlock((size_t)min<uint64_t>(outputBlockSize, textTotal));
+
+		while (textBytes < textTotal)
+		{
+			const size_t size = (size_t)min<uint64_t>(outputBlockSize, textTotal - textBytes);
+
+			if (!huffmanDecodeCharacters(decodeTable, bitstream, outputBlock.data(), size))
+				return false;
+
+			decodedText.write(reinterpret_cast<const char*>(outputBlock.data()), size);
+
+			if (collector.enabled())
+				countOutput(outputBlock.data(), size);
+
+			textBytes += size;
+			progress.update(textBytes, headerSize + bitstream.getRead() / CHAR_BIT);
+		}
+
+		if (bitstream.getRead() != bitcount)
+		{
+			HuffmanError() << "Encoded text holds more than " << textTotal << " characters";
+			return false;
+		}
+	}
+	else
+	{
+		string outputBlock;
+		outputBlock.reserve(outputBlockSize);
+
+		while (bitstream.getRead() < bitcount)
+		{
+			uint8_t c = 0;
+
+			if (!decodeTable.decode(bitstream, c))
+			{
+				HuffmanError() << "Invalid code at bit " << bitstream.getRead();
+				return false;
+			}
+
+			outputBlock += (char)c;
+
+			if (outputBlock.size() == outputBlockSize)
+			{
+				decodedText.write(outputBlock.data(), outputBlock.size());
+
+				if (collector.enabled())
+					countOutput(reinterpret_cast<const uint8_t*>(outputBlock.data()), outputBlock.size());
+
+				outputBlock.clear();
+
+				textBytes += outputBlockSize;
+				progress.update(textBytes, headerSize + bitstream.getRead() / CHAR_BIT);
+			}
+		}
+
+		decodedText.write(outputBlock.data(), outputBlock.size());
+		textBytes += outputBlock.size();
+
+		if (collector.enabled())
+			countOutput(reinterpret_cast<const uint8_t*>(outputBlock.data()), outputBlock.size());
+	}
+
+	progress.finish(textBytes, headerSize + bytecount);
+
+	if (collector.enabled())
+	{
+		//Time spent counting is not part of decoding
+		block.codingTime = duration<double>(steady_clock::now() - start).count() - block.histogramTime;
+		block.payloadBits = bitcount - tableBits;
+
+		for (size_t ch = 0; ch < HuffmanCodeTable::size; ch++)
+		{
+			if (textCounts[ch])
+				block.maxCodeLength = max(block.maxCodeLength, codeTable[(uint8_t)ch].length);
+		}
+
+		collector.addBlock(block, textBytes, false);
+		collector.addCounts(textCounts);
+		collector.finish(headerSize + bytecount, textBytes, headerSize + bytecount, 0);
+	}
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+HuffmanEncoder::HuffmanEncoder(const SHuffmanOptions& options) :
+	m_options(options)
+{}
+
+void HuffmanEncoder::reset(const SHuffmanOptions& options)
+{
+	m_options = options;
+}
+
+void HuffmanEncoder::release()
+{
+	m_bitstream = BitWriter();
+	m_index = vector<SHuffmanBlockIndexEntry>();
+	m_checkpoints = vector<SHuffmanCheckpoint>();
+	m_blockCheckpoints = vector<uint32_t>();
+	m_scratch = SHuffmanBlockScratch();
+}
+
+bool HuffmanEncoder::compress(const uint8_t* text, size_t textSize, uint8_t* encodedText, size_t encodedCapacity, size_t& encodedSize, SHuffmanStats* stats)
+{
+	HuffmanErrorScope errors(m_options.error);
+
+	StatsCollector collector(stats);
+
+	encodedSize = 0;
+
+	if (!checkCompressOptions(m_options))
+		return false;
+
+	const size_t blockSize = m_options.blockSize;
+
+	//Buffers only grow, so a text no larger than the last one allocates nothing
+	m_bitstream.reserve(huffmanBlockBound(min(blockSize, textSize), m_options.streamCount, m_options.maxCodeLength) * CHAR_BIT);
+	m_index.clear();
+	m_index.reserve((textSize + blockSize - 1) / blockSize);
+	m_checkpoints.clear();
+	m_checkpoints.reserve((size_t)checkpointCount(textSize, m_options.checkpointInterval));
+	m_blockCheckpoints.resize(max(m_blockCheckpoints.size(), (size_t)checkpointCount(min(blockSize, textSize), m_options.checkpointInterval)));
+
+	BufferWriter write(encodedText, encodedCapacity);
+	ProgressReporter progress(m_options, textSize, 0);
+	SHuffmanBlockStats blockStats;
+
+	uint64_t offset = 0;
+	bool written = writeStreamHeader(write, m_options, offset);
+
+	for (size_t position = 0; position < textSize && written; )
+	{
+		const size_t size = min(blockSize, textSize - position);
+
+		m_bitstream.clear();
+
+		if (!huffmanEncodeBlock(text + position, size, m_options.maxCodeLength, m_options.streamCount, m_bitstream, collector.blockStats(blockStats), &m_scratch,
+			m_options.checkpointInterval, m_blockCheckpoints.data(), m_options.level))
+			return false;
+
+		written = writeBlock(write, m_bitstream, size, offset, m_index);
+		addCheckpoints(m_blockCheckpoints.data(), size, m_options.checkpointInterval, position, m_index, m_checkpoints);
+		collector.addBlock(blockStats, size, true);
+
+		position += size;
+		progress.update(position, offset);
+	}
+
+	if (!(written && writeStreamEnd(write, m_index, m_checkpoints, offset)))
+	{
+		if (write.overflowed())
+			HuffmanError() << "Encoded text does not fit in " << encodedCapacity << "B, see huffmanCompressBound";
+
+		return false;
+	}
+
+	encodedSize = write.getSize();
+
+	progress.finish(textSize, offset);
+	collector.finish(textSize, offset, offset, m_index.size());
+
+	return true;
+}
+
+bool HuffmanEncoder::compress(const uint8_t* text, size_t textSize, vector<uint8_t>& encodedText, SHuffmanStats* stats)
+{
+	HuffmanErrorScope errors(m_options.error);
+
+	encodedText.resize(huffmanCompressBound(textSize, m_options));
+
+	size_t encodedSize = 0;
+	const bool compressed = compress(text, textSize, encodedText.data(), encodedText.size(), encodedSize, stats);
+
+	encodedText.resize(encodedSize);
+
+	return compressed;
+}
+
+bool HuffmanEncoder::compress(const uint8_t* text, size_t textSize, const HuffmanDictionary& dictionary, uint8_t* encodedText, size_t encodedCapacity, size_t& encodedSize)
+{
+	HuffmanErrorScope errors(m_options.error);
+
+	return huffmanCompressWithDictionary(text, textSize, dictionary, encodedText, encodedCapacity, encodedSize, m_bitstream);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+HuffmanDecoder::HuffmanDecoder(const SHuffmanOptions& options) :
+	m_options(options)
+{}
+
+void HuffmanDecoder::reset(const SHuffmanOptions& options)
+{
+	m_options = options;
+}
+
+void HuffmanDecoder::release()
+{
+	m_index = vector<SHuffmanBlockIndexEntry>();
+	m_scratch = SHuffmanBlockScratch();
+}
+
+bool HuffmanDecoder::readIndex(const uint8_t* encodedText, size_t encodedSize, SHuffmanStreamHeader& header, uint64_t& textSize)
+{
+	if (!readBlockIndex(encodedText, encodedSize, header, m_index))
+	{
+		HuffmanError() << "Encoded text is not a block stream with a valid block index";
+		return false;
+	}
+
+	textSize = 0;
+
+	for (const SHuffmanBlockIndexEntry& entry : m_index)
+		textSize += entry.size;
+
+	return true;
+}
+
+bool HuffmanDecoder::decompressedSize(const uint8_t* encodedText, size_t encodedSize, uint64_t& textSize)
+{
+	HuffmanErrorScope errors(m_options.error);
+
+	SHuffmanStreamHeader header;
+
+	return readIndex(encodedText, encodedSize, header, textSize);
+}
+
+bool HuffmanDecoder::decompress(const uint8_t* encodedText, size_t encodedSize, uint8_t* text, size_t textCapacity, size_t& textSize, SHuffmanStats* stats)
+{
+	HuffmanErrorScope errors(m_options.error);
+
+	StatsCollector collector(stats);
+
+	SHuffmanStreamHeader header;
+	uint64_t textTotal = 0;
+
+	textSize = 0;
+
+	if (!readIndex(encodedText, encodedSize, header, textTotal))
+		return false;
+
+	if (textTotal > textCapacity)
+	{
+		HuffmanError() << "Decoded text does not fit in " << textCapacity << "B, see huffmanDecompressedSize";
+		return false;
+	}
+
+	ProgressReporter progress(m_options, textTotal, encodedSize);
+	SHuffmanBlockStats blockStats;
+
+	//Blocks are decoded in order straight from the encoded text into the text
+	size_t position = 0;
+
+	for (const SHuffmanBlockIndexEntry& entry : m_index)
+	{
+		if (!decodeIndexedBlock(encodedText + entry.offset, entry, header.streamCount, text + position, collector.blockStats(blockStats), &m_scratch))
+			return false;
+
+		collector.addBlock(blockStats, entry.size, false);
+
+		position += entry.size;
+		progress.update(position, entry.offset + sizeof(SHuffmanBlockHeader) + (entry.bitcount + CHAR_BIT - 1) / CHAR_BIT);
+	}
+
+	textSize = position;
+
+	progress.finish(textSize, encodedSize);
+	collector.finish(encodedSize, textSize, encodedSize, m_index.size());
+
+	return true;
+}
+
+bool HuffmanDecoder::decompress(const uint8_t* encodedText, size_t encodedSize, vector<uint8_t>& text, SHuffmanStats* stats)
+{
+	HuffmanErrorScope errors(m_options.error);
+
+	SHuffmanStreamHeader header;
+	uint64_t textTotal = 0;
+
+	if (!readIndex(encodedText, encodedSize, header, textTotal) || textTotal > SIZE_MAX)
+		return false;
+
+	text.resize((size_t)textTotal);
+
+	size_t textSize = 0;
+	return decompress(encodedText, encodedSize, text.data(), text.size(), textSize, stats);
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
\ No newline at end of file
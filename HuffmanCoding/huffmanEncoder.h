@@ -6,15 +6,341 @@
 
 #include <string>
 #include <ostream>
+#include <istream>
+#include <functional>
+#include <vector>
+#include <cstdint>
+
+#include "huffmanTable.h"
+#include "huffmanBlock.h"
+#include "huffmanError.h"
+
+//Progress of compressing or decompressing some text
+struct SHuffmanProgress
+{
+	uint64_t textBytes = 0;			//Bytes of text encoded or decoded so far
+	uint64_t textTotal = 0;			//Bytes of text in total, 0 if unknown
+	uint64_t encodedBytes = 0;		//Bytes of encoded text written or read so far
+	uint64_t encodedTotal = 0;		//Bytes of encoded text in total, 0 if unknown
+};
+
+typedef std::function<void(const SHuffmanProgress& progress)> HuffmanProgressCallback;
+
+class HuffmanDictionary;
+
+//Options for compressing and decompressing streams
+struct SHuffmanOptions
+{
+	size_t blockSize = HUFFMAN_DEFAULT_BLOCK_SIZE;						//Maximum number of characters in a block
+	uint32_t maxCodeLength = HuffmanCodeTable::defaultLengthLimit;		//Maximum length of a code in bits
+	unsigned int threadCount = 1;										//Number of threads encoding or decoding blocks, 0 uses every hardware thread
+	unsigned int streamCount = 1;										//Number of interleaved bitstreams in each block, see huffmanEncodeBlock
+	unsigned int level = HUFFMAN_DEFAULT_LEVEL;							//Compression level, lower is faster and higher smaller, see huffmanEncodeBlock
+
+	//Number of characters between checkpoints from which huffmanDecompressRange starts decoding, 0 for none
+	//Must divide blockSize and needs a streamCount of 1, every checkpoint adds 16 bytes to the block index
+	size_t checkpointInterval = 0;
+
+	//Streams are read and written on threads of their own while blocks are coded, so reads and writes overlap coding
+	//Three batches of blocks are held in memory instead of one
+	bool pipeline = true;
+
+	//Called every progressInterval bytes of text and once more when the text is finished, never called if empty
+	//Calls are made from the calling thread, between blocks or between runs of characters, so the codec has no per character cost
+	HuffmanProgressCallback progress;
+	size_t progressInterval = 1024 * 1024;
+
+	//Called with the reason a call failed before it returns false, errors are not reported anywhere if it is not set
+	//Calls may be made from worker threads, one at a time, see HuffmanErrorScope
+	HuffmanErrorCallback error;
+};
+
+//Statistics of compressing or decompressing some text
+struct SHuffmanStats
+{
+	uint64_t inputBytes = 0;			//Bytes read, the text when compressing and the encoded text when decompressing
+	uint64_t outputBytes = 0;			//Bytes written
+	uint64_t headerBytes = 0;			//Bytes of encoded text which are not encoded characters: headers, code tables, padding and the block index
+	uint64_t payloadBits = 0;			//Bits of encoded characters
+	uint64_t symbolCount = 0;			//Number of characters encoded or decoded
+	uint64_t blockCount = 0;			//Number of blocks, 0 for single buffer encoded text
+	uint32_t maxCodeLength = 0;			//Length of the longest code used
+	double averageCodeLength = 0;		//Average bits per encoded character
+	double entropy = 0;					//Order 0 entropy of the text in bits per character, the smallest possible average code length
+
+	//Seconds spent in each stage, summed over every thread, and the elapsed time of the whole call
+	double histogramTime = 0;
+	double tableTime = 0;
+	double encodeTime = 0;
+	double decodeTime = 0;
+	double totalTime = 0;
+};
+
+//Functions taking a stats pointer fill it in when it is not null, without it no time is spent on statistics
 
 //Compresses a sequence of text using the huffman encoding algorithm and stores the encoded text
+//Empty text is stored as a header alone, without a code table
 bool huffmanCompress(
 	const std::string& text,
-	std::ostream& encodedText
+	std::ostream& encodedText,
+	const SHuffmanOptions& options = SHuffmanOptions(),
+	SHuffmanStats* stats = nullptr
+);
+
+//Compresses a sequence of text using a prebuilt code table, which must hold a code for every character in the text
+//Returns false without writing anything if a character has no code
+bool huffmanCompress(
+	const std::string& text,
+	const HuffmanCodeTable& table,
+	std::ostream& encodedText,
+	const SHuffmanOptions& options = SHuffmanOptions(),
+	SHuffmanStats* stats = nullptr
+);
+
+//Builds a table of huffman codes from the character frequencies of some text
+//No code is longer than maxCodeLength bits, if the huffman tree is deeper the codes are rebuilt within the limit
+bool huffmanBuildCodeTable(
+	const std::string& text,
+	HuffmanCodeTable& table,
+	uint32_t maxCodeLength = HuffmanCodeTable::defaultLengthLimit
+);
+
+bool huffmanBuildCodeTable(
+	const uint8_t* text,
+	size_t textSize,
+	HuffmanCodeTable& table,
+	uint32_t maxCodeLength = HuffmanCodeTable::defaultLengthLimit
+);
+
+//Builds a table of huffman codes from the frequency of every character, such as the counts of huffmanHistogram
+//Characters with a frequency of 0 get no code
+bool huffmanBuildCodeTable(
+	const uint32_t frequencies[HuffmanCodeTable::size],
+	HuffmanCodeTable& table,
+	uint32_t maxCodeLength = HuffmanCodeTable::defaultLengthLimit
+);
+
+//Builds a table of huffman codes from the counts of text of any size, such as those of huffmanHistogramAdd
+//Counts too large for 32 bits are scaled down, every character which occurs still gets a code
+bool huffmanBuildCodeTable(
+	const uint64_t counts[HuffmanCodeTable::size],
+	HuffmanCodeTable& table,
+	uint32_t maxCodeLength = HuffmanCodeTable::defaultLengthLimit
+);
+
+//Compresses a stream of text as independent blocks, followed by an index of the blocks
+//Only a few batches of blocks are held in memory at a time, so the text does not need to fit in memory
+bool huffmanCompressStream(
+	std::istream& text,
+	std::ostream& encodedText,
+	const SHuffmanOptions& options = SHuffmanOptions(),
+	SHuffmanStats* stats = nullptr
+);
+
+//Compresses text held in memory, such as a mapped file, blocks are encoded straight from the text without being copied
+bool huffmanCompressStream(
+	const uint8_t* text,
+	size_t textSize,
+	std::ostream& encodedText,
+	const SHuffmanOptions& options = SHuffmanOptions(),
+	SHuffmanStats* stats = nullptr
 );
 
 //Decompresses some encoded text and stores the decoded value
+//Accepts both single buffer encoded text and block streams, block streams are decoded in batches of blocks on options.threadCount threads
+//Streams which can seek to their block index read each batch with a single read, others are read one block at a time
 bool huffmanDecompress(
 	std::istream& encodedText,
-	std::ostream& text
+	std::ostream& text,
+	const SHuffmanOptions& options = SHuffmanOptions(),
+	SHuffmanStats* stats = nullptr
 );
+
+/*
+	Buffer functions
+
+	Compress and decompress between memory owned by the caller, without streams. Besides the threads of
+	options.threadCount, compressing allocates no more than huffmanCompressScratchSize bytes, and decompressing
+	allocates 25 bytes per block plus a decoding table of a few kilobytes for each block while it is decoded.
+*/
+
+//Largest size of the encoded text of textSize bytes of text compressed with options
+//Returns 0 if the options are invalid
+size_t huffmanCompressBound(size_t textSize, const SHuffmanOptions& options = SHuffmanOptions());
+
+//Largest number of bytes of scratch memory allocated by huffmanCompressBuffer to compress textSize bytes of text
+size_t huffmanCompressScratchSize(size_t textSize, const SHuffmanOptions& options = SHuffmanOptions());
+
+//Compresses text into encodedText, a block stream of encodedSize bytes, which huffmanDecompressBuffer can decompress
+//Returns false if the encoded text does not fit in encodedCapacity bytes, huffmanCompressBound bytes are always enough
+bool huffmanCompressBuffer(
+	const uint8_t* text,
+	size_t textSize,
+	uint8_t* encodedText,
+	size_t encodedCapacity,
+	size_t& encodedSize,
+	const SHuffmanOptions& options = SHuffmanOptions(),
+	SHuffmanStats* stats = nullptr
+);
+
+//Finds the size of the decoded text of a block stream held in memory from its block index, or of single buffer
+//encoded text from its header
+//Returns false if the encoded text is not a block stream with a valid block index or single buffer encoded text with a versioned header
+bool huffmanDecompressedSize(
+	const uint8_t* encodedText,
+	size_t encodedSize,
+	uint64_t& textSize
+);
+
+//Decompresses a block stream or single buffer encoded text held in memory into text, textSize is set to the number of characters decoded
+//Returns false if the text does not fit in textCapacity bytes, huffmanDecompressedSize gives the size needed
+//Blocks are decoded on options.threadCount threads straight from the encoded text into their place in text
+bool huffmanDecompressBuffer(
+	const uint8_t* encodedText,
+	size_t encodedSize,
+	uint8_t* text,
+	size_t textCapacity,
+	size_t& textSize,
+	const SHuffmanOptions& options = SHuffmanOptions(),
+	SHuffmanStats* stats = nullptr
+);
+
+/*
+	Range functions
+
+	Decode length characters of a block stream starting from character start, reading only the header, the parts of the
+	indexes needed to find the range and the blocks holding it. Streams with checkpoints are decoded from the checkpoint
+	before start, others from the start of the block holding it. Ranges past the end of the text are cut short.
+*/
+
+//Decompresses a range of a block stream held in memory into text, which must hold length bytes
+//textSize is set to the number of characters decoded
+bool huffmanDecompressRange(
+	const uint8_t* encodedText,
+	size_t encodedSize,
+	uint64_t start,
+	size_t length,
+	uint8_t* text,
+	size_t& textSize
+);
+
+//Decompresses a range of a block stream starting at the read position of a seekable stream
+bool huffmanDecompressRange(
+	std::istream& encodedText,
+	std::ostream& text,
+	uint64_t start,
+	uint64_t length
+);
+
+/*
+	Codec contexts
+
+	Compress and decompress block streams like the buffer functions, on the calling thread, with buffers and tables owned
+	by the context. Once a context has grown to fit the largest text passed to it, further calls make no heap allocations,
+	so many small texts are coded without any setup cost. A context may only be used by one thread at a time, keep one
+	per thread or hand them out from a pool. options.threadCount is ignored.
+
+	HuffmanDecoder only decodes block streams, single buffer encoded text and text with the older header must be
+	decompressed with huffmanDecompressBuffer or huffmanDecompress.
+*/
+class HuffmanEncoder
+{
+public:
+
+	explicit HuffmanEncoder(const SHuffmanOptions& options = SHuffmanOptions());
+
+	//Makes the encoder behave as a new encoder with options, its buffers are kept for the next text
+	void reset(const SHuffmanOptions& options = SHuffmanOptions());
+
+	//Frees the buffers grown to fit previous texts, such as after an unusually large text
+	void release();
+
+	//Compresses text into encodedText as huffmanCompressBuffer does
+	bool compress(
+		const uint8_t* text,
+		size_t textSize,
+		uint8_t* encodedText,
+		size_t encodedCapacity,
+		size_t& encodedSize,
+		SHuffmanStats* stats = nullptr
+	);
+
+	//Compresses text into encodedText, which is resized to fit, allocates only if encodedText lacks the capacity
+	bool compress(
+		const uint8_t* text,
+		size_t textSize,
+		std::vector<uint8_t>& encodedText,
+		SHuffmanStats* stats = nullptr
+	);
+
+	//Compresses text into a message referencing dictionary as huffmanCompressWithDictionary does
+	//Messages are decompressed with huffmanDecompressWithDictionary, which needs no context as it never allocates
+	bool compress(
+		const uint8_t* text,
+		size_t textSize,
+		const HuffmanDictionary& dictionary,
+		uint8_t* encodedText,
+		size_t encodedCapacity,
+		size_t& encodedSize
+	);
+
+	const SHuffmanOptions& getOptions() const { return m_options; }
+
+private:
+
+	SHuffmanOptions m_options;
+	BitWriter m_bitstream;								//Bitstream of the block being encoded
+	std::vector<SHuffmanBlockIndexEntry> m_index;
+	std::vector<SHuffmanCheckpoint> m_checkpoints;
+	std::vector<uint32_t> m_blockCheckpoints;			//Bit offsets of the checkpoints of the block being encoded
+	SHuffmanBlockScratch m_scratch;
+};
+
+class HuffmanDecoder
+{
+public:
+
+	explicit HuffmanDecoder(const SHuffmanOptions& options = SHuffmanOptions());
+
+	//Makes the decoder behave as a new decoder with options, its buffers are kept for the next text
+	void reset(const SHuffmanOptions& options = SHuffmanOptions());
+
+	//Frees the buffers grown to fit previous texts
+	void release();
+
+	//Decompresses a block stream into text as huffmanDecompressBuffer does, returns false for any other encoded text
+	bool decompress(
+		const uint8_t* encodedText,
+		size_t encodedSize,
+		uint8_t* text,
+		size_t textCapacity,
+		size_t& textSize,
+		SHuffmanStats* stats = nullptr
+	);
+
+	//Finds the size of the decoded text of a block stream, returns false for any other encoded text
+	bool decompressedSize(
+		const uint8_t* encodedText,
+		size_t encodedSize,
+		uint64_t& textSize
+	);
+
+	//Decompresses a block stream into text, which is resized to fit, allocates only if text lacks the capacity
+	bool decompress(
+		const uint8_t* encodedText,
+		size_t encodedSize,
+		std::vector<uint8_t>& text,
+		SHuffmanStats* stats = nullptr
+	);
+
+	const SHuffmanOptions& getOptions() const { return m_options; }
+
+private:
+
+	//Reads the header and block index of a block stream, textSize is set to the size of its decoded text
+	bool readIndex(const uint8_t* encodedText, size_t encodedSize, SHuffmanStreamHeader& header, uint64_t& textSize);
+
+	SHuffmanOptions m_options;
+	std::vector<SHuffmanBlockIndexEntry> m_index;
+	SHuffmanBlockScratch m_scratch;
+};
@@ -0,0 +1,58 @@
+/*
+	Error reporting
+*/
+
+#include "huffmanError.h"
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//Callback of the innermost scope of each thread
+static thread_local SHuffmanErrorSink* currentSink = nullptr;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+HuffmanErrorScope::HuffmanErrorScope(const HuffmanErrorCallback& callback) :
+	m_previous(currentSink)
+{
+	if (callback)
+	{
+		m_sink.callback = &callback;
+		currentSink = &m_sink;
+	}
+}
+
+HuffmanErrorScope::HuffmanErrorScope(SHuffmanErrorSink* sink) :
+	m_previous(currentSink)
+{
+	if (sink)
+		currentSink = sink;
+}
+
+HuffmanErrorScope::~HuffmanErrorScope()
+{
+	currentSink = m_previous;
+}
+
+SHuffmanErrorSink* huffmanErrorSink()
+{
+	return currentSink;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+HuffmanError::HuffmanError() :
+	m_sink(currentSink)
+{}
+
+HuffmanError::~HuffmanError()
+{
+	if (m_sink)
+	{
+		lock_guard<mutex> guard(m_sink->lock);
+		(*m_sink->callback)(m_message.str());
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,84 @@
+/*
+	Error reporting
+
+	Functions of the codec return false when they fail and report why to an error callback, instead of writing to a
+	console the calling program may not have. Functions taking SHuffmanOptions report to options.error, the others,
+	such as those of huffmanBlock.h and huffmanDictionary.h, to the callback of a HuffmanErrorScope around the call.
+	Without a callback errors are not reported anywhere.
+*/
+
+#pragma once
+
+#include <string>
+#include <sstream>
+#include <functional>
+#include <mutex>
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//Called with a message describing why a call failed, without a trailing newline
+typedef std::function<void(const std::string& message)> HuffmanErrorCallback;
+
+//Callback shared by a scope and the threads started within it
+struct SHuffmanErrorSink
+{
+	const HuffmanErrorCallback* callback = nullptr;
+	std::mutex lock;		//Threads report one call at a time
+};
+
+//Reports the errors of every call made on the calling thread to a callback while it is in scope, the callback is not
+//copied so it must outlive the scope, and threads the codec starts for those calls report to it one call at a time
+//An empty callback leaves the callback of an enclosing scope in place
+class HuffmanErrorScope
+{
+public:
+
+	explicit HuffmanErrorScope(const HuffmanErrorCallback& callback);
+
+	//Reports to the callback of another thread, used by the threads the codec starts
+	explicit HuffmanErrorScope(SHuffmanErrorSink* sink);
+
+	~HuffmanErrorScope();
+
+	HuffmanErrorScope(const HuffmanErrorScope&) = delete;
+	HuffmanErrorScope& operator=(const HuffmanErrorScope&) = delete;
+
+private:
+
+	SHuffmanErrorSink m_sink;
+	SHuffmanErrorSink* m_previous;
+};
+
+//Callback the calling thread reports errors to, or null if it has none
+SHuffmanErrorSink* huffmanErrorSink();
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//Builds an error message and reports it to the callback of the calling thread once the statement ends
+//Nothing is formatted when the thread has no callback
+class HuffmanError
+{
+public:
+
+	HuffmanError();
+	~HuffmanError();
+
+	HuffmanError(const HuffmanError&) = delete;
+	HuffmanError& operator=(const HuffmanError&) = delete;
+
+	template<typename Type>
+	HuffmanError& operator<<(const Type& value)
+	{
+		if (m_sink)
+			m_message << value;
+
+		return *this;
+	}
+
+private:
+
+	SHuffmanErrorSink* m_sink;
+	std::ostringstream m_message;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,95 @@
+/*
+	Character histogram
+*/
+
+#include "huffmanHistogram.h"
+
+#include <cstring>
+
+//Runs of one character are found with SSE2 compares, which every x64 processor has
+//Characters are still counted one at a time by the scalar banks below, SSE2 only lets a whole run skip them
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HUFFMAN_HISTOGRAM_RUNS
+#include <emmintrin.h>
+#endif
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//Number of separate banks of counters
+//Repeated characters would otherwise make every increment wait for the previous store to the same counter
+static const size_t bankCount = 4;
+
+//Counts the 8 characters of a word, spread over every bank
+static inline void countWord(uint64_t word, uint32_t banks[bankCount][HuffmanCodeTable::size])
+{
+	banks[0][(uint8_t)(word)]++;
+	banks[1][(uint8_t)(word >> 8)]++;
+	banks[2][(uint8_t)(word >> 16)]++;
+	banks[3][(uint8_t)(word >> 24)]++;
+	banks[0][(uint8_t)(word >> 32)]++;
+	banks[1][(uint8_t)(word >> 40)]++;
+	banks[2][(uint8_t)(word >> 48)]++;
+	banks[3][(uint8_t)(word >> 56)]++;
+}
+
+void huffmanHistogram(const uint8_t* text, size_t textSize, uint32_t counts[HuffmanCodeTable::size])
+{
+	uint32_t banks[bankCount][HuffmanCodeTable::size] = {};
+
+	size_t i = 0;
+
+#ifdef HUFFMAN_HISTOGRAM_RUNS
+	//Runs of one character are common in skewed text, 16 characters of one run are counted with a single add
+	//Any other 16 characters are counted by the scalar banks, no faster than the word loop below
+	for (; (i + 16) <= textSize; i += 16)
+	{
+		const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+		const __m128i first = _mm_set1_epi8((char)text[i]);
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, first)) == 0xFFFF)
+		{
+			banks[0][text[i]] += 16;
+			continue;
+		}
+
+		uint64_t words[2];
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(words), chunk);
+
+		countWord(words[0], banks);
+		countWord(words[1], banks);
+	}
+#endif
+
+	//Characters are loaded a word at a time
+	for (; (i + sizeof(uint64_t)) <= textSize; i += sizeof(uint64_t))
+	{
+		uint64_t word = 0;
+		memcpy(&word, text + i, sizeof(uint64_t));
+
+		countWord(word, banks);
+	}
+
+	for (; i < textSize; i++)
+		banks[0][text[i]]++;
+
+	//Merge the banks
+	for (size_t ch = 0; ch < HuffmanCodeTable::size; ch++)
+		counts[ch] = banks[0][ch] + banks[1][ch] + banks[2][ch] + banks[3][ch];
+}
+
+void huffmanHistogramAdd(const uint8_t* text, size_t textSize, uint64_t counts[HuffmanCodeTable::size])
+{
+	//Texts are counted in parts which cannot overflow the 32 bit counts
+	const size_t partSize = (size_t)1 << 30;
+
+	for (size_t position = 0; position < textSize; position += partSize)
+	{
+		uint32_t partCounts[HuffmanCodeTable::size];
+		huffmanHistogram(text + position, (textSize - position < partSize) ? (textSize - position) : partSize, partCounts);
+
+		for (size_t ch = 0; ch < HuffmanCodeTable::size; ch++)
+			counts[ch] += partCounts[ch];
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
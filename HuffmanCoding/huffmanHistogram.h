@@ -0,0 +1,31 @@
+/*
+	Character histogram
+
+	Counts the number of times each character occurs in some text, the first pass of building a code table
+*/
+
+#pragma once
+
+#include "huffmanTable.h"
+
+#include <cstdint>
+#include <cstddef>
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//Counts every character of some text, counts must hold an entry for every character and is overwritten
+//Texts of 4GB or more must be counted in parts and their counts added together
+void huffmanHistogram(
+	const uint8_t* text,
+	size_t textSize,
+	uint32_t counts[HuffmanCodeTable::size]
+);
+
+//Adds the count of every character of some text of any size to counts
+void huffmanHistogramAdd(
+	const uint8_t* text,
+	size_t textSize,
+	uint64_t counts[HuffmanCodeTable::size]
+);
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,529 @@
+/*
+	Huffman code tables
+*/
+
+#include "huffmanTable.h"
+
+#include <algorithm>
+#include <bitset>
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool HuffmanCodeTable::build(const HuffmanTree& tree, HuffmanNode root)
+{
+	for (SHuffmanCode& code : m_codes)
+		code = SHuffmanCode();
+
+	m_canonical = false;
+
+	//A tree without any branches has no codes
+	if (!tree.isNode(root) || tree.isNodeLeaf(root))
+		return false;
+
+	return fillCodes(tree, root, 0, 0);
+}
+
+bool HuffmanCodeTable::fillCodes(const HuffmanTree& tree, HuffmanNode node, uint32_t pattern, uint32_t depth)
+{
+	if (!tree.isNode(node))
+		return true;
+
+	const HuffmanTree::Children& children = tree.children(node);
+
+	if (children.empty())
+	{
+		const uint8_t value = tree.value(node);
+
+		m_codes[value].pattern = pattern;
+		m_codes[value].length = depth;
+
+		return true;
+	}
+
+	//Codes are stored in a 32 bit pattern
+	if (depth == maxCodeLength)
+		return false;
+
+	//Left branch appends a 0, right branch appends a 1
+	return fillCodes(tree, children.left(), (pattern << 1), depth + 1) &&
+		fillCodes(tree, children.right(), (pattern << 1) | 1, depth + 1);
+}
+
+bool HuffmanCodeTable::buildCanonical(const uint8_t lengths[size])
+{
+	m_canonical = false;
+
+	//Count the number of codes of each length
+	uint32_t lengthCount[maxCodeLength + 1] = {};
+
+	for (size_t ch = 0; ch < size; ch++)
+	{
+		if (lengths[ch] > maxCodeLength)
+			return false;
+
+		lengthCount[lengths[ch]]++;
+	}
+
+	lengthCount[0] = 0;
+
+	//Find the first code of each length, codes of one length follow on from the codes of the previous length
+	uint64_t nextCode[maxCodeLength + 1] = {};
+	uint64_t code = 0;
+
+	for (uint32_t length = 1; length <= maxCodeLength; length++)
+	{
+		code = (code + lengthCount[length - 1]) << 1;
+		nextCode[length] = code;
+
+		//More codes of this length than can be distinguished
+		if ((code + lengthCount[length]) > (1ull << length))
+			return false;
+	}
+
+	//Assign consecutive codes to characters of the same length
+	//The table is cleared in one go first, clearing each unused code inside the loop is several times slower
+	for (SHuffmanCode& code : m_codes)
+		code = SHuffmanCode();
+
+	for (size_t ch = 0; ch < size; ch++)
+	{
+		const uint32_t length = lengths[ch];
+
+		if (length == 0)
+			continue;
+
+		m_codes[ch].pattern = (uint32_t)nextCode[length]++;
+		m_codes[ch].length = length;
+	}
+
+	m_canonical = true;
+
+	return true;
+}
+
+/*
+	Code lengths are stored as:
+	 - 3 bits: width of each code length field
+	 - a sequence of entries covering all characters in order, each entry is either:
+		- 1 bit set followed by the code length of the next character
+		- 1 bit clear followed by 8 bits holding the number of following characters without a code, minus 1
+*/
+void HuffmanCodeTable::serialize(BitWriter& stream) const
+{
+	uint32_t lengthBits = 1;
+
+	while ((1u << lengthBits) <= getMaxLength())
+		lengthBits++;
+
+	stream.write(lengthBits, 3);
+
+	for (size_t ch = 0; ch < size; ch++)
+	{
+		if (m_codes[ch].length)
+		{
+			stream.writebit(1);
+			stream.write(m_codes[ch].length, lengthBits);
+		}
+		else
+		{
+			size_t run = 1;
+
+			while (((ch + run) < size) && (m_codes[ch + run].length == 0))
+				run++;
+
+			stream.writebit(0);
+			stream.write(run - 1, 8);
+
+			ch += run - 1;
+		}
+	}
+}
+
+size_t HuffmanCodeTable::getSerializedBits() const
+{
+	uint32_t lengthBits = 1;
+
+	while ((1u << lengthBits) <= getMaxLength())
+		lengthBits++;
+
+	size_t bits = 3;
+
+	for (size_t ch = 0; ch < size; ch++)
+	{
+		if (m_codes[ch].length)
+		{
+			bits += 1 + lengthBits;
+		}
+		else
+		{
+			//Runs of up to 256 characters without a code take 9 bits
+			while (((ch + 1) < size) && (m_codes[ch + 1].length == 0))
+				ch++;
+
+			bits += 9;
+		}
+	}
+
+	return bits;
+}
+
+bool HuffmanCodeTable::deserialize(BitReader& stream)
+{
+	uint8_t lengths[size] = {};
+
+	const uint32_t lengthBits = (uint32_t)stream.read(3);
+
+	if (lengthBits == 0 || lengthBits > 6)
+		return false;
+
+	for (size_t ch = 0; ch < size;)
+	{
+		if (stream.readbit())
+			lengths[ch++] = (uint8_t)stream.read(lengthBits);
+		else
+			ch += (size_t)stream.read(8) + 1;
+	}
+
+	//Truncated streams read as zeroes past the end
+	if (stream.overrun())
+		return false;
+
+	return buildCanonical(lengths);
+}
+
+uint32_t HuffmanCodeTable::getMaxLength() const
+{
+	uint32_t maxLength = 0;
+
+	for (const SHuffmanCode& code : m_codes)
+		maxLength = max(maxLength, code.length);
+
+	return maxLength;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+	In-place code lengths (Moffat and Katajainen)
+
+	Characters are sorted by frequency once, then the huffman tree is built inside the sorted array: leaves are taken
+	from the front of the array and internal nodes, which are created in order of weight, replace the leaves already used.
+	The array then holds the parent of each internal node, which is turned into node depths and finally into leaf depths.
+*/
+bool huffmanCodeLengths(const uint32_t frequencies[HuffmanCodeTable::size], uint8_t lengths[HuffmanCodeTable::size])
+{
+	//Characters sorted by frequency, with the character in the low 8 bits so equal frequencies keep a fixed order
+	uint64_t sorted[HuffmanCodeTable::size];
+	size_t count = 0;
+
+	for (size_t ch = 0; ch < HuffmanCodeTable::size; ch++)
+	{
+		lengths[ch] = 0;
+
+		if (frequencies[ch] != 0)
+			sorted[count++] = ((uint64_t)frequencies[ch] << 8) | ch;
+	}
+
+	if (count == 0)
+		return false;
+
+	sort(sorted, sorted + count);
+
+	//A single character still needs one bit
+	if (count == 1)
+	{
+		lengths[sorted[0] & 0xFF] = 1;
+		return true;
+	}
+
+	//Weight of every node, sums of up to 256 32 bit frequencies fit in 64 bits
+	uint64_t a[HuffmanCodeTable::size];
+
+	for (size_t i = 0; i < count; i++)
+		a[i] = sorted[i] >> 8;
+
+	//Build the tree, a[next] becomes the weight of each new internal node and a used internal node is replaced by its parent
+	size_t leaf = 2;
+	size_t root = 0;
+
+	a[0] += a[1];
+
+	for (size_t next = 1; next < (count - 1); next++)
+	{
+		//First child
+		if (leaf >= count || a[root] < a[leaf])
+		{
+			a[next] = a[root];
+			a[root++] = next;
+		}
+		else
+		{
+			a[next] = a[leaf++];
+		}
+
+		//Second child
+		if (leaf >= count || (root < next && a[root] < a[leaf]))
+		{
+			a[next] += a[root];
+			a[root++] = next;
+		}
+		else
+		{
+			a[next] += a[leaf++];
+		}
+	}
+
+	//Turn parent indices into the depth of each internal node, the root is the last internal node
+	a[count - 2] = 0;
+
+	for (size_t next = count - 2; next-- > 0;)
+		a[next] = a[a[next]] + 1;
+
+	//Count the internal nodes at each depth, every free slot below them holds a leaf
+	//Leaves are assigned from the end of the array so the least frequent characters get the longest codes
+	size_t available = 1;
+	size_t used = 0;
+	size_t depth = 0;
+	size_t internal = count - 1;	//Internal nodes left to count, plus 1
+	size_t next = count;			//Leaves left to assign, plus 1
+
+	while (available > 0)
+	{
+		while (internal > 0 && a[internal - 1] == depth)
+		{
+			used++;
+			internal--;
+		}
+
+		while (available > used)
+		{
+			a[--next] = depth;
+			available--;
+		}
+
+		available = 2 * used;
+		depth++;
+		used = 0;
+	}
+
+	for (size_t i = 0; i < count; i++)
+		lengths[sorted[i] & 0xFF] = (uint8_t)a[i];
+
+	return true;
+}
+
+/*
+	Package-merge
+
+	Each list holds the characters sorted by frequency merged with packages, pairs of adjacent items from the list below.
+	The first 2n-2 items of the top list make an optimal length limited code, the code length of a character is the number
+	of selected items it appears in, either directly or inside a package.
+
+	Characters keep their order within every list, so the selected characters of a list are always the first few. Only
+	the weights of two lists and which items of each list are characters need to be kept, all in fixed size arrays.
+*/
+bool huffmanLimitedCodeLengths(const uint32_t frequencies[HuffmanCodeTable::size], uint32_t maxLength, uint8_t lengths[HuffmanCodeTable::size])
+{
+	//Characters sorted by frequency, with the character in the low 8 bits so equal frequencies keep a fixed order
+	uint64_t sorted[HuffmanCodeTable::size];
+	size_t count = 0;
+
+	for (size_t ch = 0; ch < HuffmanCodeTable::size; ch++)
+	{
+		lengths[ch] = 0;
+
+		if (frequencies[ch] != 0)
+			sorted[count++] = ((uint64_t)frequencies[ch] << 8) | ch;
+	}
+
+	if (count == 0 || maxLength == 0 || maxLength > HuffmanCodeTable::maxCodeLength)
+		return false;
+
+	sort(sorted, sorted + count);
+
+	//A single character still needs one bit
+	if (count == 1)
+	{
+		lengths[sorted[0] & 0xFF] = 1;
+		return true;
+	}
+
+	//Not enough codes of maxLength bits
+	if (maxLength < 32 && count > ((size_t)1 << maxLength))
+		return false;
+
+	//A list holds every character and at most count - 1 packages
+	const size_t maxListSize = 2 * HuffmanCodeTable::size;
+
+	//Weights of the list being built and of the list below it
+	uint64_t weights[2][maxListSize];
+
+	//Items of each list which are characters, one list per code length starting with the longest codes
+	bitset<maxListSize> isLeaf[HuffmanCodeTable::maxCodeLength];
+	size_t listSizes[HuffmanCodeTable::maxCodeLength];
+
+	for (size_t i = 0; i < count; i++)
+	{
+		weights[0][i] = sorted[i] >> 8;
+		isLeaf[0][i] = true;
+	}
+
+	listSizes[0] = count;
+
+	for (uint32_t level = 1; level < maxLength; level++)
+	{
+		const uint64_t* below = weights[(level - 1) & 1];
+		const size_t belowSize = listSizes[level - 1];
+		uint64_t* list = weights[level & 1];
+
+		isLeaf[level].reset();
+
+		size_t size = 0;
+		size_t leaf = 0;
+		size_t pair = 0;
+
+		//Merge the characters with the packages of the list below, both are already in order
+		while (leaf < count || (pair + 1) < belowSize)
+		{
+			const bool hasPackage = (pair + 1) < belowSize;
+			const uint64_t leafWeight = (leaf < count) ? (sorted[leaf] >> 8) : 0;
+
+			if (leaf < count && (!hasPackage || leafWeight <= (below[pair] + below[pair + 1])))
+			{
+				isLeaf[level][size] = true;
+				list[size++] = leafWeight;
+				leaf++;
+			}
+			else
+			{
+				list[size++] = below[pair] + below[pair + 1];
+				pair += 2;
+			}
+		}
+
+		listSizes[level] = size;
+	}
+
+	//Select items from the top list down, each selected package selects the two items it was made from
+	size_t selected = 2 * count - 2;
+
+	for (uint32_t level = maxLength; level > 0; level--)
+	{
+		const size_t taken = min(selected, listSizes[level - 1]);
+		size_t leaves = 0;
+
+		for (size_t i = 0; i < taken; i++)
+			leaves += isLeaf[level - 1][i] ? 1 : 0;
+
+		//Selected characters are the least frequent ones
+		for (size_t i = 0; i < leaves; i++)
+			lengths[sorted[i] & 0xFF]++;
+
+		selected = 2 * (taken - leaves);
+	}
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+HuffmanDecodeTable::HuffmanDecodeTable(unsigned int lookupBits) :
+	m_lookupBits(min(max(lookupBits, 1u), (unsigned int)maxLookupBits))
+{}
+
+bool HuffmanDecodeTable::build(const HuffmanCodeTable& codes)
+{
+	m_entries.clear();
+
+	const unsigned int maxLength = codes.getMaxLength();
+
+	if (maxLength == 0)
+		return false;
+
+	//Short codes do not need the full primary table
+	m_primaryBits = min(m_lookupBits, maxLength);
+	m_entries.resize((size_t)1 << m_primaryBits);
+
+	//Insert the longest codes first so each sub-table is sized for the longest code sharing its prefix
+	for (unsigned int length = maxLength; length > 0; length--)
+	{
+		for (size_t ch = 0; ch < HuffmanCodeTable::size; ch++)
+		{
+			const SHuffmanCode& code = codes[(uint8_t)ch];
+
+			if (code.length == length)
+				insertCode(code.pattern, length, (uint8_t)ch);
+		}
+	}
+
+	return true;
+}
+
+bool HuffmanDecodeTable::decodeLong(BitReader& stream, uint8_t& ch) const
+{
+	uint32_t bits = m_primaryBits;
+	const Entry* entry = &m_entries[(size_t)stream.peek(bits)];
+
+	//Long codes continue in a sub-table indexed by the bits following the primary index
+	while (entry->link)
+	{
+		stream.consume(bits);
+		bits = entry->length;
+		entry = &m_entries[entry->value + (size_t)stream.peek(bits)];
+	}
+
+	//Unused entries are left with a length of 0
+	if (entry->length == 0)
+		return false;
+
+	stream.consume(entry->length);
+	ch = (uint8_t)entry->value;
+
+	return true;
+}
+
+void HuffmanDecodeTable::insertCode(uint32_t code, unsigned int length, uint8_t ch)
+{
+	size_t table = 0;
+	unsigned int tableBits = m_primaryBits;
+
+	//Follow the code through the sub-tables, creating them where they are missing
+	while (length > tableBits)
+	{
+		length -= tableBits;
+
+		const size_t index = table + (code >> length);
+		code &= (1u << length) - 1;
+
+		if (!m_entries[index].link)
+		{
+			const unsigned int subBits = min(m_lookupBits, length);
+			const size_t subTable = m_entries.size();
+
+			m_entries.resize(subTable + ((size_t)1 << subBits));
+
+			m_entries[index].value = (uint32_t)subTable;
+			m_entries[index].length = (uint8_t)subBits;
+			m_entries[index].link = true;
+		}
+
+		table = m_entries[index].value;
+		tableBits = m_entries[index].length;
+	}
+
+	//Every index starting with the rest of the code decodes to the same character
+	const unsigned int freeBits = tableBits - length;
+	const size_t first = table + ((size_t)code << freeBits);
+	const size_t last = first + ((size_t)1 << freeBits);
+
+	for (size_t i = first; i < last; i++)
+	{
+		m_entries[i].value = ch;
+		m_entries[i].length = (uint8_t)length;
+		m_entries[i].link = false;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
\ No newline at end of file
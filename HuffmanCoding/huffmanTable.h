@@ -0,0 +1,160 @@
+/*
+	Huffman code tables
+
+	Lookup tables for translating between characters and huffman codes without walking the huffman tree
+*/
+
+#pragma once
+
+#include "binarytree.h"
+#include "bitstream.h"
+
+#include <vector>
+#include <cstdint>
+
+typedef BinaryTree<uint8_t> HuffmanTree;
+typedef HuffmanTree::NodeId HuffmanNode;
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//Huffman code of a single character
+struct SHuffmanCode
+{
+	uint32_t pattern = 0;	//Code bits in the low bits of the pattern, the first bit of the code is bit (length - 1)
+	uint32_t length = 0;	//Number of bits in the code, 0 if the character has no code
+};
+
+/*
+	Character to code table
+
+	Holds the code of every character so encoding a character is a single lookup instead of a tree search.
+	A table can be built once and reused to encode any number of buffers.
+
+	Canonical tables assign codes in order of (length, character), so the codes can be rebuilt from the code lengths alone
+	and the table is stored as a list of code lengths instead of a tree.
+*/
+class HuffmanCodeTable
+{
+public:
+
+	//Number of characters in the table
+	enum { size = 256 };
+
+	//Maximum length of a code in bits
+	enum { maxCodeLength = 32 };
+
+	//Default limit on the length of built codes, keeps decoding tables small
+	enum { defaultLengthLimit = 15 };
+
+	//Builds the table by walking a huffman tree once, returns false if the tree has no codes or a code is too long
+	bool build(const HuffmanTree& tree, HuffmanNode root);
+
+	//Builds a canonical table from the code length of every character, returns false if the lengths do not form a prefix code
+	bool buildCanonical(const uint8_t lengths[size]);
+
+	//Writes the code lengths of a canonical table to a bitstream
+	void serialize(BitWriter& stream) const;
+
+	//Number of bits serialize writes
+	size_t getSerializedBits() const;
+
+	//Most bits serialize can write, when every other character has a code of 32 bits, whose 6 bit length takes 7 bits
+	//with its flag, and each character between them is a run of 1 character without a code, which takes 9 bits
+	enum { maxSerializedBits = 3 + (size / 2) * (1 + 6) + (size / 2) * 9 };
+
+	//Reads code lengths from a bitstream and builds a canonical table from them
+	bool deserialize(BitReader& stream);
+
+	const SHuffmanCode& operator[](uint8_t ch) const { return m_codes[ch]; }
+
+	//Length of the longest code in the table
+	uint32_t getMaxLength() const;
+
+	//Returns true if the codes were assigned from their lengths
+	bool isCanonical() const { return m_canonical; }
+
+private:
+
+	bool fillCodes(const HuffmanTree& tree, HuffmanNode node, uint32_t pattern, uint32_t depth);
+
+	SHuffmanCode m_codes[size];
+	bool m_canonical = false;
+};
+
+//Computes optimal code lengths for a set of character frequencies without building a tree or allocating memory
+//Characters with a frequency of 0 get no code, a single character gets a 1 bit code, returns false if no character has a frequency
+bool huffmanCodeLengths(
+	const uint32_t frequencies[HuffmanCodeTable::size],
+	uint8_t lengths[HuffmanCodeTable::size]
+);
+
+//Computes optimal code lengths of at most maxLength bits for a set of character frequencies using the package-merge algorithm
+//Characters with a frequency of 0 get no code, returns false if the characters cannot fit in codes of maxLength bits
+bool huffmanLimitedCodeLengths(
+	const uint32_t frequencies[HuffmanCodeTable::size],
+	uint32_t maxLength,
+	uint8_t lengths[HuffmanCodeTable::size]
+);
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+	Multi-bit decoding table
+
+	The table is indexed by the next N bits of an encoded stream, each entry holds a decoded character and the length of its code
+	so a whole character is decoded per lookup. Codes longer than N bits are resolved through linked sub-tables,
+	with canonical codes these share long prefixes so only a few sub-tables are needed.
+*/
+class HuffmanDecodeTable
+{
+public:
+
+	//Default number of bits used to index the primary table
+	enum { defaultLookupBits = 11 };
+
+	//Maximum number of bits used to index any table
+	enum { maxLookupBits = 16 };
+
+	struct Entry
+	{
+		uint32_t value = 0;	//Decoded character, or the offset of a sub-table if this is a link entry
+		uint8_t length = 0;	//Number of code bits left to consume at this table, or the index width of the sub-table if this is a link entry
+		bool link = false;	//True if the code continues in a sub-table
+	};
+
+	HuffmanDecodeTable(unsigned int lookupBits = defaultLookupBits);
+
+	//Builds the table from the codes of a code table, returns false if the code table is empty
+	bool build(const HuffmanCodeTable& codes);
+
+	//Decodes the next character of a bitstream and moves the read pointer past its code
+	bool decode(BitReader& stream, uint8_t& ch) const
+	{
+		const Entry& entry = m_entries[(size_t)stream.peek(m_primaryBits)];
+
+		//Most codes are resolved by the primary table, kept small so it is inlined into decoding loops
+		if (entry.link || entry.length == 0)
+			return decodeLong(stream, ch);
+
+		stream.consume(entry.length);
+		ch = (uint8_t)entry.value;
+
+		return true;
+	}
+
+	unsigned int getLookupBits() const { return m_lookupBits; }
+	size_t getEntryCount() const { return m_entries.size(); }
+
+private:
+
+	void insertCode(uint32_t code, unsigned int length, uint8_t ch);
+
+	//Decodes codes continuing in sub-tables, and invalid codes
+	bool decodeLong(BitReader& stream, uint8_t& ch) const;
+
+	unsigned int m_lookupBits;		//Maximum index width of each table
+	unsigned int m_primaryBits = 0;	//Index width of the primary table
+	std::vector<Entry> m_entries;	//Primary table followed by all sub-tables
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
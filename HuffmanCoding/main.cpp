@@ -5,14 +5,48 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <chrono>
+#include <iterator>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
 
 #include "binarycalc.h"
 #include "binarytree.h"
 #include "bitstream.h"
 
 #include "huffmanEncoder.h"
+#include "huffmanDictionary.h"
+#include "mappedFile.h"
 
 using namespace std;
+using namespace std::chrono;
+
+//Options read from the command line
+struct SArguments
+{
+	bool compress = false;
+	bool train = false;
+	string targetName;		//Empty if the target is read from stdin
+	string outputName;		//Empty if the output is written to stdout
+	string dictionaryName;	//Empty unless the target is a single message compressed with a dictionary
+	uint32_t maxCodeLength = HuffmanCodeTable::defaultLengthLimit;
+	size_t blockSize = HUFFMAN_DEFAULT_BLOCK_SIZE;
+	unsigned int threadCount = 1;	//0 uses every hardware thread
+	unsigned int streamCount = 1;
+	size_t checkpointInterval = 0;	//0 writes no checkpoints
+	unsigned int level = HUFFMAN_DEFAULT_LEVEL;
+	bool range = false;				//Only rangeLength characters from rangeStart are decompressed
+	uint64_t rangeStart = 0;
+	uint64_t rangeLength = 0;
+	bool pipeline = true;			//Streams are read and written while blocks are coded
+	bool silent = false;			//No progress or messages are printed
+	bool statsText = false;			//Statistics are printed as text
+	bool statsJson = false;			//Statistics are printed as JSON in place of progress and messages
+};
 
 /*
 	* Parses command line arguments.
@@ -22,12 +56,47 @@ using namespace std;
 		--decompress
 	* compress a target
 		--compress
-	* target file path
+	* train a dictionary on the target and write the dictionary file to the output
+		--train
+	* compress or decompress the target as a single message with a dictionary file made by --train
+		--dictionary [path]
+	* target file path, stdin is read if no target is given
 		--target [path]
-	* output file path
+	* output file path, stdout is written if no output is given
 		--output [path]
+	* maximum length of a huffman code in bits
+		--maxcodelength [bits]
+	* number of bytes compressed in each block
+		--blocksize [bytes]
+	* number of threads compressing or decompressing blocks, 0 uses every hardware thread
+		--threads [count]
+	* number of interleaved bitstreams in each compressed block, more bitstreams decode faster on a single thread
+		--streams [count]
+	* compression level from 1 to 5, lower levels build code tables from a sample of each block, higher levels try splitting blocks
+		--level [level]
+	* number of characters between checkpoints written when compressing, from which --range starts decoding
+		--checkpoints [characters]
+	* decompress only length characters of the target starting from character start, the target must be a file
+		--range [start:length]
+	* read, code and write streams in turn instead of reading and writing on threads of their own while blocks are coded
+		--nopipeline
+	* print no progress or messages, only errors
+		--silent
+	* print statistics of the compressed or decompressed text, json replaces progress and messages with a single JSON object
+		--stats [text|json]
 */
-bool parseArguments(const string& commandline, bool& compress, string& targetname, string& outputname);
+bool parseArguments(const string& commandline, SArguments& args);
+
+//Trains a dictionary, or compresses or decompresses a message with a dictionary, returns the exit code
+//targetMap is the mapped target file, the target is read whole from its stream if it is not open
+int dictionaryMain(const SArguments& args, const MappedFile& targetMap);
+
+//Prints the progress of compressing or decompressing, start is the time the codec was started
+void printProgress(const SHuffmanProgress& progress, steady_clock::time_point start);
+
+//Prints statistics of compressing or decompressing
+void printStats(const SHuffmanStats& stats, bool compress);
+void printStatsJson(const SHuffmanStats& stats, bool compress);
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -46,22 +115,121 @@ int main(int argc, char** argv)
 		commandline += " ";
 	}
 
-	bool compress = false;
-	string targetName;
-	string outputName;
+	SArguments args;
 
-	if (!parseArguments(commandline, compress, targetName, outputName))
+	if (!parseArguments(commandline, args))
 	{
 		cerr << "Invalid arguments\n";
 		return 1;
 	}
 
-	ios::open_mode outflags = ios::out;	//Write
-	ios::open_mode targetflags = ios::in;	//Read
+	SHuffmanOptions options;
+	options.blockSize = args.blockSize;
+	options.maxCodeLength = args.maxCodeLength;
+	options.threadCount = args.threadCount;
+	options.streamCount = args.streamCount;
+	options.checkpointInterval = args.checkpointInterval;
+	options.level = args.level;
+	options.pipeline = args.pipeline;
+
+	//Errors of the codec are printed, including those of the dictionary and range functions which take no options
+	options.error = [](const string& message)
+	{
+		cerr << message << "\n";
+	};
+
+	HuffmanErrorScope errors(options.error);
+
+	//JSON statistics are the only thing printed so they can be parsed
+	if (args.statsJson)
+		args.silent = true;
+
+	const steady_clock::time_point start = steady_clock::now();
+
+	if (!args.silent)
+	{
+		options.progress = [start](const SHuffmanProgress& progress)
+		{
+			printProgress(progress, start);
+		};
+	}
+
+	//Statistics are only collected when they are printed, decoders count the decoded text for them
+	SHuffmanStats stats;
+	SHuffmanStats* statsOut = (args.statsText || args.statsJson || (args.compress && !args.silent)) ? &stats : nullptr;
+
+	//Prints the statistics asked for once the text is compressed or decompressed
+	auto reportStats = [&args, &stats]()
+	{
+		if (args.statsJson)
+			printStatsJson(stats, args.compress);
+		else if (args.statsText)
+			printStats(stats, args.compress);
+	};
+
+	//Target files are mapped into memory where possible so the codec reads them in place
+	MappedFile targetMap;
+
+	if (!args.targetName.empty())
+		targetMap.openRead(args.targetName);
+
+	if (args.train || !args.dictionaryName.empty())
+	{
+		if (args.statsText || args.statsJson)
+		{
+			cerr << "--stats cannot be used with --train or --dictionary\n";
+			return 1;
+		}
+
+		return dictionaryMain(args, targetMap);
+	}
+
+	if (args.range && (args.compress || args.targetName.empty()))
+	{
+		cerr << "--range can only decompress a target file\n";
+		return 1;
+	}
+
+	//Block streams with an index and single buffer encoded text with a versioned header are decoded straight into a mapped output file of the decoded size
+	uint64_t decodedSize = 0;
+
+	if (!args.compress && !args.range && targetMap.isOpen() && !args.outputName.empty() &&
+		huffmanDecompressedSize(targetMap.data(), targetMap.size(), decodedSize))
+	{
+		MappedFile outputMap;
+
+		if (decodedSize > SIZE_MAX || !outputMap.create(args.outputName, (size_t)decodedSize))
+		{
+			cerr << "Unable able to open output file: \"" << args.outputName << "\"\n";
+			return 1;
+		}
+
+		size_t textSize = 0;
+
+		if (!huffmanDecompressBuffer(targetMap.data(), targetMap.size(), outputMap.data(), outputMap.size(), textSize, options, statsOut))
+		{
+			//The output already has the full decoded size, so it would look complete if it were left behind
+			outputMap.close();
+			remove(args.outputName.c_str());
+
+			cerr << "\nAn error occurred during decompression\n";
+			return 1;
+		}
+
+		if (!args.silent)
+			cout << "\nDecompressed.\n";
+
+		reportStats();
+
+		return 0;
+	}
+
+	ios::openmode outflags = ios::out;	//Write
+	ios::openmode targetflags = ios::in;	//Read
 
 	//When in compression mode the output must be a binary stream
 	//When in decompression mode the target must be a binary stream
-	if (compress)
+	if (args.compress)
 	{
 		//Compression mode
 		outflags |= ios::binary;
@@ -72,60 +240,295 @@ int main(int argc, char** argv)
 		targetflags |= ios::binary;
 	}
 
-	ofstream outputfile(outputName, outflags);
-	ifstream targetfile(targetName, targetflags);
+	ofstream outputfile;
+	ifstream targetfile;
+
+	//Standard streams are used in place of missing file paths
+	istream* target = &cin;
+	ostream stdoutStream(cout.rdbuf());
+	ostream* output = &stdoutStream;
+
+	if (args.outputName.empty())
+	{
+#ifdef _WIN32
+		if (args.compress)
+			_setmode(_fileno(stdout), _O_BINARY);
+#endif
+		//Messages must not be mixed into the output
+		cout.rdbuf(cerr.rdbuf());
+	}
+	else
+	{
+		outputfile.open(args.outputName, outflags);
+		output = &outputfile;
+	}
+
+	if (args.targetName.empty())
+	{
+#ifdef _WIN32
+		if (!args.compress)
+			_setmode(_fileno(stdin), _O_BINARY);
+#endif
+	}
+	else
+	{
+		targetfile.open(args.targetName, targetflags);
+		target = &targetfile;
+	}
 
 	//Check if file streams were opened correctly
-	if (outputfile.fail())
+	if (output->fail())
 	{
-		cerr << "Unable able to open output file: \"" << outputName << "\"\n";
+		cerr << "Unable able to open output file: \"" << args.outputName << "\"\n";
 		return 1;
 	}
 
-	if (targetfile.fail())
+	if (target->fail())
 	{
-		cerr << "Unable to open target file: \"" << targetName << "\"\n";
+		cerr << "Unable to open target file: \"" << args.targetName << "\"\n";
 		return 1;
 	}
 	
 	//Compression mode
-	if (compress)
+	if (args.compress)
 	{
-		stringstream targetstream;
-		targetstream << targetfile.rdbuf();
+		if (!args.silent)
+			cout << "Beginning compression.\n";
+
+		//Mapped targets are encoded in place, otherwise the target is compressed in batches of blocks as it is read
+		const bool compressed = targetMap.isOpen() ?
+			huffmanCompressStream(targetMap.data(), targetMap.size(), *output, options, statsOut) :
+			huffmanCompressStream(*target, *output, options, statsOut);
 
-		if (targetstream.fail())
+		if (!compressed)
 		{
-			cerr << "Unable to copy target stream\n";
+			cerr << "\nAn error occured during compression\n";
 			return 1;
 		}
 
-		if (!huffmanCompress(targetstream.str(), outputfile))
+		output->flush();
+
+		if (output->fail())
 		{
-			cerr << "An error occured during compression\n";
+			cerr << "Unable to write encoded text to output\n";
 			return 1;
 		}
 
-		if (outputfile.fail())
+		if (!args.silent)
 		{
-			cerr << "Unable to write encoded text to output\n";
+			cout << "\nCompressed.\n";
+			cout << "Text length: " << stats.inputBytes << "B\n";
+			cout << "Compressed text length: " << stats.outputBytes << "B\n";
+
+			if (stats.inputBytes)
+				cout << "Compression ratio: " << (float)stats.outputBytes / stats.inputBytes << endl;
+		}
+
+		reportStats();
+	}
+	//Range mode, only the blocks holding the range are read
+	else if (args.range)
+	{
+		if (!huffmanDecompressRange(*target, *output, args.rangeStart, args.rangeLength))
+		{
+			cerr << "\nAn error occurred during decompression\n";
 			return 1;
 		}
+
+		output->flush();
+
+		if (output->fail())
+		{
+			cerr << "Unable to write decoded text to output\n";
+			return 1;
+		}
+
+		if (!args.silent)
+			cout << "\nDecompressed range.\n";
 	}
 	//Decompression mode
 	else
 	{
-		if (!huffmanDecompress(targetfile, outputfile))
+		if (!huffmanDecompress(*target, *output, options, statsOut))
 		{
-			cerr << "An error occurred during decompression\n";
+			cerr << "\nAn error occurred during decompression\n";
 			return 1;
 		}
 
-		if (outputfile.fail())
+		output->flush();
+
+		if (output->fail())
 		{
 			cerr << "Unable to write decoded text to output\n";
 			return 1;
 		}
+
+		if (!args.silent)
+			cout << "\nDecompressed.\n";
+
+		reportStats();
+	}
+
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+
+int dictionaryMain(const SArguments& args, const MappedFile& targetMap)
+{
+	if (args.train && !args.dictionaryName.empty())
+	{
+		cerr << "--train and --dictionary cannot be used together\n";
+		return 1;
+	}
+
+	//Dictionaries are trained on, and messages are coded from, the whole target held in memory
+	const uint8_t* target = targetMap.data();
+	size_t targetSize = targetMap.size();
+	vector<uint8_t> targetBuffer;
+
+	if (!targetMap.isOpen())
+	{
+		ifstream targetfile;
+		istream* targetStream = &cin;
+
+		if (args.targetName.empty())
+		{
+#ifdef _WIN32
+			_setmode(_fileno(stdin), _O_BINARY);
+#endif
+		}
+		else
+		{
+			targetfile.open(args.targetName, ios::in | ios::binary);
+			targetStream = &targetfile;
+		}
+
+		if (targetStream->fail())
+		{
+			cerr << "Unable to open target file: \"" << args.targetName << "\"\n";
+			return 1;
+		}
+
+		targetBuffer.assign(istreambuf_iterator<char>(*targetStream), istreambuf_iterator<char>());
+
+		target = targetBuffer.data();
+		targetSize = targetBuffer.size();
+	}
+
+	ofstream outputfile;
+	ostream stdoutStream(cout.rdbuf());
+	ostream* output = &stdoutStream;
+
+	if (args.outputName.empty())
+	{
+#ifdef _WIN32
+		_setmode(_fileno(stdout), _O_BINARY);
+#endif
+		//Messages must not be mixed into the output
+		cout.rdbuf(cerr.rdbuf());
+	}
+	else
+	{
+		outputfile.open(args.outputName, ios::out | ios::binary);
+		output = &outputfile;
+	}
+
+	if (output->fail())
+	{
+		cerr << "Unable able to open output file: \"" << args.outputName << "\"\n";
+		return 1;
+	}
+
+	HuffmanDictionary dictionary;
+
+	if (args.train)
+	{
+		if (!dictionary.train(target, targetSize, args.maxCodeLength) || !dictionary.save(*output))
+		{
+			cerr << "Unable to train dictionary\n";
+			return 1;
+		}
+
+		output->flush();
+
+		if (output->fail())
+		{
+			cerr << "Unable to write dictionary to output\n";
+			return 1;
+		}
+
+		if (!args.silent)
+			cout << "Trained dictionary " << dictionary.getId() << " on " << targetSize << "B of samples.\n";
+
+		return 0;
+	}
+
+	ifstream dictionaryfile(args.dictionaryName, ios::in | ios::binary);
+
+	if (!dictionaryfile.is_open() || !dictionary.load(dictionaryfile))
+	{
+		cerr << "Unable to load dictionary file: \"" << args.dictionaryName << "\"\n";
+		return 1;
+	}
+
+	vector<uint8_t> result;
+	size_t resultSize = 0;
+
+	if (args.compress)
+	{
+		result.resize(huffmanDictionaryCompressBound(targetSize, dictionary));
+
+		if (!huffmanCompressWithDictionary(target, targetSize, dictionary, result.data(), result.size(), resultSize))
+		{
+			cerr << "An error occured during compression\n";
+			return 1;
+		}
+	}
+	else
+	{
+		//Messages name their dictionary, which is looked up as a decoder of many kinds of message would
+		HuffmanDictionarySet dictionaries;
+		dictionaries.add(dictionary);
+
+		uint32_t dictionaryId = 0;
+
+		if (!huffmanMessageInfo(target, targetSize, dictionaryId, resultSize))
+		{
+			cerr << "Target is too short to be a message\n";
+			return 1;
+		}
+
+		result.resize(resultSize);
+
+		if (!huffmanDecompressWithDictionary(target, targetSize, dictionaries, result.data(), result.size(), resultSize))
+		{
+			cerr << "An error occurred during decompression\n";
+			return 1;
+		}
+	}
+
+	output->write(reinterpret_cast<const char*>(result.data()), resultSize);
+	output->flush();
+
+	if (output->fail())
+	{
+		cerr << "Unable to write to output\n";
+		return 1;
+	}
+
+	if (!args.silent)
+	{
+		if (args.compress)
+		{
+			cout << "Compressed with dictionary " << dictionary.getId() << ".\n";
+			cout << "Text length: " << targetSize << "B\n";
+			cout << "Compressed text length: " << resultSize << "B\n";
+		}
+		else
+		{
+			cout << "Decompressed.\n";
+		}
 	}
 
 	return 0;
@@ -133,6 +536,81 @@ int main(int argc, char** argv)
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////
 
+void printProgress(const SHuffmanProgress& progress, steady_clock::time_point start)
+{
+	const long long elapsed = (long long)duration_cast<milliseconds>(steady_clock::now() - start).count();
+
+	cout << "\r";
+
+	//Percentage of the text if its size is known, otherwise of the encoded text
+	if (progress.textTotal || progress.encodedTotal)
+	{
+		const uint64_t perc = progress.textTotal ?
+			(progress.textBytes * 100) / progress.textTotal :
+			(progress.encodedBytes * 100) / progress.encodedTotal;
+
+		cout << perc << "% completed (" << elapsed << "ms): " << string((size_t)perc / 5, '|');
+	}
+	else
+	{
+		cout << progress.textBytes << "B completed (" << elapsed << "ms)";
+	}
+
+	cout.flush();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void printStats(const SHuffmanStats& stats, bool compress)
+{
+	const uint64_t textBytes = compress ? stats.inputBytes : stats.outputBytes;
+	const uint64_t encodedBytes = compress ? stats.outputBytes : stats.inputBytes;
+
+	cout << "Text length: " << textBytes << "B\n";
+	cout << "Encoded length: " << encodedBytes << "B (" << stats.headerBytes << "B of headers and code tables, " << stats.payloadBits << " bits of codes)\n";
+	cout << "Characters: " << stats.symbolCount << " in " << stats.blockCount << " blocks\n";
+	cout << "Code length: " << stats.averageCodeLength << " bits average, " << stats.maxCodeLength << " bits longest, " << stats.entropy << " bits entropy\n";
+	cout << "Histogram: " << stats.histogramTime * 1000 << "ms\n";
+	cout << "Code tables: " << stats.tableTime * 1000 << "ms\n";
+	cout << (compress ? "Encoding: " : "Decoding: ") << (compress ? stats.encodeTime : stats.decodeTime) * 1000 << "ms\n";
+	cout << "Total: " << stats.totalTime * 1000 << "ms\n";
+}
+
+void printStatsJson(const SHuffmanStats& stats, bool compress)
+{
+	const uint64_t textBytes = compress ? stats.inputBytes : stats.outputBytes;
+	const uint64_t encodedBytes = compress ? stats.outputBytes : stats.inputBytes;
+
+	char buffer[1024];
+
+	snprintf(buffer, sizeof(buffer),
+		"{\"mode\":\"%s\",\"input_bytes\":%llu,\"output_bytes\":%llu,\"header_bytes\":%llu,\"payload_bits\":%llu,"
+		"\"symbol_count\":%llu,\"block_count\":%llu,\"max_code_length\":%u,\"average_code_length\":%.6f,\"entropy\":%.6f,\"ratio\":%.6f,"
+		"\"seconds\":{\"histogram\":%.6f,\"table\":%.6f,\"encode\":%.6f,\"decode\":%.6f,\"total\":%.6f}}\n",
+		compress ? "compress" : "decompress",
+		(unsigned long long)stats.inputBytes,
+		(unsigned long long)stats.outputBytes,
+		(unsigned long long)stats.headerBytes,
+		(unsigned long long)stats.payloadBits,
+		(unsigned long long)stats.symbolCount,
+		(unsigned long long)stats.blockCount,
+		stats.maxCodeLength,
+		stats.averageCodeLength,
+		stats.entropy,
+		textBytes ? (double)encodedBytes / textBytes : 0.0,
+		stats.histogramTime,
+		stats.tableTime,
+		stats.encodeTime,
+		stats.decodeTime,
+		stats.totalTime
+	);
+
+	cout << buffer;
+	cout.flush();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+
 vector<string> tokenize(const string& str, const char* delim)
 {
 	vector<string> tokens;
@@ -154,7 +632,7 @@ vector<string> tokenize(const string& str, const char* delim)
 	return tokens;
 }
 
-bool parseArguments(const string& _commandline, bool& compress, string& targetname, string& outputname)
+bool parseArguments(const string& _commandline, SArguments& args)
 {
 	string commandline(_commandline);
 
@@ -203,11 +681,15 @@ bool parseArguments(const string& _commandline, bool& compress, string& targetna
 		
 		if (argType == "compress")
 		{
-			compress = true;
+			args.compress = true;
+		}
+		else if (argType == "train")
+		{
+			args.train = true;
 		}
 		else if (argType == "decompress")
 		{
-			compress = false;
+			args.compress = false;
 		}
 		else if (argType == "target")
 		{
@@ -218,9 +700,9 @@ bool parseArguments(const string& _commandline, bool& compress, string& targetna
 			}
 
 			//If path is surrounded by "" then ignore them
-			targetname = argParam.substr(argParam.find_first_not_of('\"'), argParam.find_last_not_of('\"') + 1);
+			args.targetName = argParam.substr(argParam.find_first_not_of('\"'), argParam.find_last_not_of('\"') + 1);
 
-			for (char& c : targetname)
+			for (char& c : args.targetName)
 			{
 				if (c == '\?')
 					c = ' ';
@@ -235,14 +717,129 @@ bool parseArguments(const string& _commandline, bool& compress, string& targetna
 			}
 
 			//If path is surrounded by "" then ignore them
-			outputname = argParam.substr(argParam.find_first_not_of('\"'), argParam.find_last_not_of('\"') + 1);
+			args.outputName = argParam.substr(argParam.find_first_not_of('\"'), argParam.find_last_not_of('\"') + 1);
 
-			for (char& c : outputname)
+			for (char& c : args.outputName)
 			{
 				if (c == '\?')
 					c = ' ';
 			}
 		}
+		else if (argType == "dictionary")
+		{
+			if (argParam.empty())
+			{
+				cerr << "--dictionary must have one parameter\n";
+				return false;
+			}
+
+			//If path is surrounded by "" then ignore them
+			args.dictionaryName = argParam.substr(argParam.find_first_not_of('\"'), argParam.find_last_not_of('\"') + 1);
+
+			for (char& c : args.dictionaryName)
+			{
+				if (c == '\?')
+					c = ' ';
+			}
+		}
+		else if (argType == "maxcodelength")
+		{
+			args.maxCodeLength = (uint32_t)strtoul(argParam.c_str(), nullptr, 10);
+
+			if (args.maxCodeLength == 0 || args.maxCodeLength > HuffmanCodeTable::maxCodeLength)
+			{
+				cerr << "--maxcodelength must be between 1 and " << HuffmanCodeTable::maxCodeLength << "\n";
+				return false;
+			}
+		}
+		else if (argType == "blocksize")
+		{
+			args.blockSize = (size_t)strtoull(argParam.c_str(), nullptr, 10);
+
+			if (args.blockSize == 0 || args.blockSize > HUFFMAN_MAX_BLOCK_SIZE)
+			{
+				cerr << "--blocksize must be between 1 and " << HUFFMAN_MAX_BLOCK_SIZE << "\n";
+				return false;
+			}
+		}
+		else if (argType == "threads")
+		{
+			if (argParam.empty())
+			{
+				cerr << "--threads must have one parameter\n";
+				return false;
+			}
+
+			args.threadCount = (unsigned int)strtoul(argParam.c_str(), nullptr, 10);
+		}
+		else if (argType == "silent")
+		{
+			args.silent = true;
+		}
+		else if (argType == "nopipeline")
+		{
+			args.pipeline = false;
+		}
+		else if (argType == "stats")
+		{
+			if (argParam.empty() || argParam == "text")
+			{
+				args.statsText = true;
+			}
+			else if (argParam == "json")
+			{
+				args.statsJson = true;
+			}
+			else
+			{
+				cerr << "--stats must be text or json\n";
+				return false;
+			}
+		}
+		else if (argType == "streams")
+		{
+			args.streamCount = (unsigned int)strtoul(argParam.c_str(), nullptr, 10);
+
+			if (args.streamCount == 0 || args.streamCount > HUFFMAN_MAX_STREAM_COUNT)
+			{
+				cerr << "--streams must be between 1 and " << HUFFMAN_MAX_STREAM_COUNT << "\n";
+				return false;
+			}
+		}
+		else if (argType == "level")
+		{
+			args.level = (unsigned int)strtoul(argParam.c_str(), nullptr, 10);
+
+			if (args.level < HUFFMAN_MIN_LEVEL || args.level > HUFFMAN_MAX_LEVEL)
+			{
+				cerr << "--level must be between " << HUFFMAN_MIN_LEVEL << " and " << HUFFMAN_MAX_LEVEL << "\n";
+				return false;
+			}
+		}
+		else if (argType == "checkpoints")
+		{
+			args.checkpointInterval = (size_t)strtoull(argParam.c_str(), nullptr, 10);
+
+			if (args.checkpointInterval == 0)
+			{
+				cerr << "--checkpoints must be at least 1\n";
+				return false;
+			}
+		}
+		else if (argType == "range")
+		{
+			const size_t splitpos = argParam.find(':');
+
+			if (splitpos == string::npos)
+			{
+				cerr << "--range must be start:length\n";
+				return false;
+			}
+
+			args.range = true;
+			args.rangeStart = strtoull(argParam.substr(0, splitpos).c_str(), nullptr, 10);
+			args.rangeLength = strtoull(argParam.substr(splitpos + 1).c_str(), nullptr, 10);
+		}
 	}
 
 	return true;
@@ -0,0 +1,201 @@
+/*
+	Memory mapped file class
+*/
+
+#include "mappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifdef _WIN32
+
+bool MappedFile::openRead(const string& path)
+{
+	close();
+
+	m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+	if (m_file == INVALID_HANDLE_VALUE)
+	{
+		m_file = nullptr;
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+
+	if (!GetFileSizeEx(m_file, &fileSize) || (uint64_t)fileSize.QuadPart > SIZE_MAX)
+	{
+		close();
+		return false;
+	}
+
+	m_size = (size_t)fileSize.QuadPart;
+	m_open = true;
+
+	//Empty files cannot be mapped
+	if (m_size == 0)
+		return true;
+
+	m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	m_data = m_mapping ? (uint8_t*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+
+	if (!m_data)
+	{
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+bool MappedFile::create(const string& path, size_t size)
+{
+	close();
+
+	m_file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+	if (m_file == INVALID_HANDLE_VALUE)
+	{
+		m_file = nullptr;
+		return false;
+	}
+
+	m_size = size;
+	m_open = true;
+
+	if (m_size == 0)
+		return true;
+
+	//Mapping a file larger than its current size extends it
+	const uint64_t mappingSize = (uint64_t)size;
+
+	m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READWRITE, (DWORD)(mappingSize >> 32), (DWORD)mappingSize, nullptr);
+	m_data = m_mapping ? (uint8_t*)MapViewOfFile(m_mapping, FILE_MAP_WRITE, 0, 0, 0) : nullptr;
+
+	if (!m_data)
+	{
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (m_data)
+		UnmapViewOfFile(m_data);
+
+	if (m_mapping)
+		CloseHandle(m_mapping);
+
+	if (m_file)
+		CloseHandle(m_file);
+
+	m_data = nullptr;
+	m_mapping = nullptr;
+	m_file = nullptr;
+	m_size = 0;
+	m_open = false;
+}
+
+#else
+
+bool MappedFile::openRead(const string& path)
+{
+	close();
+
+	m_file = ::open(path.c_str(), O_RDONLY);
+
+	if (m_file < 0)
+		return false;
+
+	struct stat fileStat;
+
+	//Only regular files have a fixed size which can be mapped
+	if (fstat(m_file, &fileStat) != 0 || !S_ISREG(fileStat.st_mode) || (uint64_t)fileStat.st_size > SIZE_MAX)
+	{
+		close();
+		return false;
+	}
+
+	m_size = (size_t)fileStat.st_size;
+	m_open = true;
+
+	//Empty files cannot be mapped
+	if (m_size == 0)
+		return true;
+
+	void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_file, 0);
+
+	if (data == MAP_FAILED)
+	{
+		close();
+		return false;
+	}
+
+	m_data = (uint8_t*)data;
+
+	//Files are read from start to end
+	madvise(data, m_size, MADV_SEQUENTIAL);
+
+	return true;
+}
+
+bool MappedFile::create(const string& path, size_t size)
+{
+	close();
+
+	m_file = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+	if (m_file < 0)
+		return false;
+
+	m_size = size;
+	m_open = true;
+
+	if (m_size == 0)
+		return true;
+
+	void* data = (ftruncate(m_file, (off_t)size) == 0) ? mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_file, 0) : MAP_FAILED;
+
+	if (data == MAP_FAILED)
+	{
+		close();
+		return false;
+	}
+
+	m_data = (uint8_t*)data;
+
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (m_data)
+		munmap(m_data, m_size);
+
+	if (m_file >= 0)
+		::close(m_file);
+
+	m_data = nullptr;
+	m_file = -1;
+	m_size = 0;
+	m_open = false;
+}
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,56 @@
+/*
+	Memory mapped file class
+
+	Maps the contents of a file into memory so it can be read or written in place, without copying it through a stream buffer
+*/
+
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class MappedFile
+{
+public:
+
+	MappedFile() {}
+	~MappedFile() { close(); }
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	//Maps an existing file for reading, returns false if the file cannot be opened or mapped
+	bool openRead(const std::string& path);
+
+	//Creates or truncates a file of size bytes and maps it for writing, returns false if the file cannot be created or mapped
+	bool create(const std::string& path, size_t size);
+
+	//Unmaps the file, written pages are stored to the file by the system
+	void close();
+
+	//Mapped contents, null if the file is empty
+	const uint8_t* data() const { return m_data; }
+	uint8_t* data() { return m_data; }
+
+	size_t size() const { return m_size; }
+
+	bool isOpen() const { return m_open; }
+
+private:
+
+	uint8_t* m_data = nullptr;
+	size_t m_size = 0;
+	bool m_open = false;
+
+#ifdef _WIN32
+	void* m_file = nullptr;		//File handle
+	void* m_mapping = nullptr;	//File mapping handle
+#else
+	int m_file = -1;			//File descriptor
+#endif
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
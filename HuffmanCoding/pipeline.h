@@ -0,0 +1,214 @@
+/*
+	Pipeline
+
+	Runs the three stages of coding a stream over a small ring of batches: a reader thread filling batches from the input,
+	the calling thread coding them, and a writer thread draining them to the output in order. The stages are connected
+	by bounded lock free queues, so only the batches of the ring are ever held in memory, and the input and output are
+	busy at the same time as the codec.
+*/
+
+#pragma once
+
+#include "huffmanError.h"
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//Bounded lock free queue with a single producer thread and a single consumer thread
+template<typename T>
+class SpscQueue
+{
+public:
+
+	explicit SpscQueue(size_t capacity) :
+		m_items(capacity + 1)
+	{}
+
+	SpscQueue(const SpscQueue&) = delete;
+	SpscQueue& operator=(const SpscQueue&) = delete;
+
+	//Adds an item, waiting while the queue is full, returns false if the queue was cancelled
+	bool push(const T& item)
+	{
+		const size_t tail = m_tail.load(std::memory_order_relaxed);
+		const size_t next = (tail + 1) % m_items.size();
+
+		for (unsigned int spins = 0; next == m_head.load(std::memory_order_acquire); spins++)
+		{
+			if (m_cancelled.load(std::memory_order_relaxed))
+				return false;
+
+			backoff(spins);
+		}
+
+		m_items[tail] = item;
+		m_tail.store(next, std::memory_order_release);
+
+		return true;
+	}
+
+	//Removes the oldest item, waiting while the queue is empty, returns false if the queue was cancelled
+	bool pop(T& item)
+	{
+		const size_t head = m_head.load(std::memory_order_relaxed);
+
+		for (unsigned int spins = 0; head == m_tail.load(std::memory_order_acquire); spins++)
+		{
+			if (m_cancelled.load(std::memory_order_relaxed))
+				return false;
+
+			backoff(spins);
+		}
+
+		item = m_items[head];
+		m_head.store((head + 1) % m_items.size(), std::memory_order_release);
+
+		return true;
+	}
+
+	//Makes waiting and future calls to push and pop return false
+	void cancel() { m_cancelled.store(true, std::memory_order_relaxed); }
+
+private:
+
+	//Waits are short while both stages are busy, but a stage blocked on a slow disk may keep the other waiting for a long time
+	//so waiting threads yield at first and then sleep instead of spinning
+	static void backoff(unsigned int spins)
+	{
+		if (spins < 64)
+			std::this_thread::yield();
+		else
+			std::this_thread::sleep_for(std::chrono::microseconds(50));
+	}
+
+	std::vector<T> m_items;
+	std::atomic<size_t> m_head{ 0 };		//Next item to pop, only written by the consumer
+	std::atomic<size_t> m_tail{ 0 };		//Next item to push, only written by the producer
+	std::atomic<bool> m_cancelled{ false };
+};
+
+//Stages of a pipeline, each returns false if it fails, which stops every stage
+template<typename Batch>
+struct SPipelineStages
+{
+	std::function<bool(Batch& batch, bool& last)> read;		//Fills a batch, last is set once the input is finished
+	std::function<bool(Batch& batch)> process;					//Codes a batch, called on the calling thread
+	std::function<bool(Batch& batch)> write;					//Writes a batch, batches are written in the order they were read
+};
+
+/*
+	Passes every batch of the input through the stages, reusing the batches of a ring
+	Each stage runs on its own thread when there are at least two batches, otherwise the stages run in turn on the calling thread
+	Returns once every stage has finished, false if any stage failed
+*/
+template<typename Batch>
+bool runPipeline(std::vector<Batch>& batches, const SPipelineStages<Batch>& stages)
+{
+	bool last = false;
+
+	if (batches.size() < 2)
+	{
+		Batch& batch = batches.front();
+
+		while (!last)
+		{
+			if (!stages.read(batch, last) || !stages.process(batch) || !stages.write(batch))
+				return false;
+		}
+
+		return true;
+	}
+
+	//A batch moving between stages, and whether it holds the end of the input
+	struct SItem
+	{
+		size_t batch = 0;
+		bool last = false;
+	};
+
+	SpscQueue<SItem> emptied(batches.size());	//Writer to reader
+	SpscQueue<SItem> filled(batches.size());	//Reader to calling thread
+	SpscQueue<SItem> coded(batches.size());		//Calling thread to writer
+
+	std::atomic<bool> failed(false);
+
+	auto fail = [&]()
+	{
+		failed = true;
+		emptied.cancel();
+		filled.cancel();
+		coded.cancel();
+	};
+
+	for (size_t i = 0; i < batches.size(); i++)
+	{
+		SItem item;
+		item.batch = i;
+		emptied.push(item);
+	}
+
+	//The reader and writer report errors to the callback of the calling thread
+	SHuffmanErrorSink* errors = huffmanErrorSink();
+
+	std::thread reader([&]()
+	{
+		HuffmanErrorScope scope(errors);
+		SItem item;
+
+		while (!item.last && emptied.pop(item))
+		{
+			if (!stages.read(batches[item.batch], item.last))
+			{
+				fail();
+				return;
+			}
+
+			if (!filled.push(item))
+				return;
+		}
+	});
+
+	std::thread writer([&]()
+	{
+		HuffmanErrorScope scope(errors);
+		SItem item;
+
+		while (!item.last && coded.pop(item))
+		{
+			if (!stages.write(batches[item.batch]))
+			{
+				fail();
+				return;
+			}
+
+			if (!item.last && !emptied.push(item))
+				return;
+		}
+	});
+
+	SItem item;
+
+	while (!item.last && filled.pop(item))
+	{
+		if (!stages.process(batches[item.batch]))
+		{
+			fail();
+			break;
+		}
+
+		if (!coded.push(item))
+			break;
+	}
+
+	reader.join();
+	writer.join();
+
+	return !failed;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,164 @@
+/*
+	Thread pool class
+
+	A fixed set of worker threads which run the iterations of a loop in parallel,
+	the calling thread works through the loop alongside the workers
+*/
+
+#pragma once
+
+#include "huffmanError.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class ThreadPool
+{
+public:
+
+	typedef std::function<void(size_t)> Task;
+
+	//Loop body which is also passed the index of the thread running it, from 0 for the calling thread to getThreadCount() - 1
+	typedef std::function<void(size_t, unsigned int)> ThreadTask;
+
+	//Create a pool running loops on threadCount threads, including the calling thread
+	//A threadCount of 0 uses one thread per hardware thread
+	ThreadPool(unsigned int threadCount = 0)
+	{
+		if (threadCount == 0)
+			threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+		for (unsigned int i = 1; i < threadCount; i++)
+			m_threads.push_back(std::thread(&ThreadPool::workerMain, this, i));
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+
+		m_wake.notify_all();
+
+		for (std::thread& t : m_threads)
+			t.join();
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	//Calls task(i) for every i in [0, count) and returns once every call has finished
+	void parallelFor(size_t count, const Task& task)
+	{
+		parallelFor(count, ThreadTask([&task](size_t i, unsigned int) { task(i); }));
+	}
+
+	//Calls task(i, thread) for every i in [0, count), so each thread can work in memory of its own
+	void parallelFor(size_t count, const ThreadTask& task)
+	{
+		if (m_threads.empty())
+		{
+			for (size_t i = 0; i < count; i++)
+				task(i, 0);
+
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			m_task = &task;
+			m_count = count;
+			m_errors = huffmanErrorSink();
+			m_next = 0;
+			m_busy = m_threads.size();
+			m_generation++;
+		}
+
+		m_wake.notify_all();
+
+		runTask(task, count, 0);
+
+		//Wait for the workers to finish their last iterations
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_done.wait(lock, [this]() { return m_busy == 0; });
+
+		m_task = nullptr;
+	}
+
+	//Number of threads running loops, including the calling thread
+	unsigned int getThreadCount() const { return (unsigned int)m_threads.size() + 1; }
+
+private:
+
+	void runTask(const ThreadTask& task, size_t count, unsigned int thread)
+	{
+		size_t i = 0;
+
+		while ((i = m_next++) < count)
+			task(i, thread);
+	}
+
+	void workerMain(unsigned int thread)
+	{
+		uint64_t generation = 0;
+
+		while (true)
+		{
+			const ThreadTask* task = nullptr;
+			size_t count = 0;
+			SHuffmanErrorSink* errors = nullptr;
+
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_wake.wait(lock, [&]() { return m_stop || m_generation != generation; });
+
+				if (m_stop)
+					return;
+
+				generation = m_generation;
+				task = m_task;
+				count = m_count;
+				errors = m_errors;
+			}
+
+			{
+				//Errors are reported to the callback of the thread which started the loop
+				HuffmanErrorScope scope(errors);
+				runTask(*task, count, thread);
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+
+				if (--m_busy == 0)
+					m_done.notify_one();
+			}
+		}
+	}
+
+	std::vector<std::thread> m_threads;
+
+	std::mutex m_mutex;
+	std::condition_variable m_wake;		//Signalled when a loop starts or the pool stops
+	std::condition_variable m_done;		//Signalled when the last worker finishes a loop
+
+	const ThreadTask* m_task = nullptr;		//Loop body of the current loop
+	size_t m_count = 0;					//Number of iterations in the current loop
+	SHuffmanErrorSink* m_errors = nullptr;	//Error callback of the thread running the current loop
+	std::atomic<size_t> m_next{ 0 };	//Next iteration to run
+	size_t m_busy = 0;					//Number of workers still running the current loop
+	uint64_t m_generation = 0;			//Incremented for every loop
+	bool m_stop = false;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
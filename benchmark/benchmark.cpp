@@ -0,0 +1,1155 @@
+/*
+	Huffman coding benchmark
+
+	Measures the throughput of every stage of compressing and decompressing a set of corpora at a range of sizes.
+	Corpora are generated from a fixed seed or tiled from files, and every measurement is the fastest of several
+	samples, so runs on the same machine print the same table within timing noise.
+
+	Heap allocations are counted, and the run fails if the encoder and decoder contexts allocate once they have
+	coded a text of the same size.
+
+	Batches of records cut from each corpus are then compressed and decompressed with the batch functions, with and
+	without a shared table, and measured in records per second.
+
+	Each corpus is then compressed and decompressed at every compression level, measured in MB/s next to its ratio.
+
+	Finally random ranges are decompressed from each corpus compressed with and without checkpoints, and measured in
+	microseconds per range. Range corpora and their encoded text are written to files in the working directory and
+	mapped, so a 10G range size measures random 4K reads from a 10 GB text on machines with less memory, given the
+	disk space for both files.
+
+	Usage:
+		huffmanBenchmark [--sizes 100,10K,1M,16M] [--corpora text,random,skewed,single,binary]
+			[--text path] [--binary path] [--samples count] [--streams count] [--threads count]
+			[--records 64,256,1K,4K] [--batch count] [--ranges 16M,256M] [--range-length 4K]
+			[--checkpoints characters] [--reads count] [--levels 1,2,3,4,5] [--csv]
+*/
+
+#include "huffmanEncoder.h"
+#include "huffmanDictionary.h"
+#include "huffmanBatch.h"
+#include "huffmanHistogram.h"
+#include "bitstream.h"
+#include "mappedFile.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define HUFFMAN_BENCHMARK_RDTSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HUFFMAN_BENCHMARK_RDTSC
+#endif
+
+using namespace std;
+using namespace std::chrono;
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//Options read from the command line
+struct SBenchmarkArguments
+{
+	vector<string> sizeNames = { "100", "10K", "1M", "16M" };
+	vector<string> corpora = { "text", "random", "skewed", "single", "binary" };
+	vector<string> recordSizeNames = { "64", "256", "1K", "4K" };
+	size_t batchSize = 10000;		//Number of records in a batch
+	vector<unsigned int> levels = { 1, 2, 3, 4, 5 };
+	vector<string> rangeSizeNames = { "16M" };
+	string rangeLengthName = "4K";
+	size_t checkpointInterval = 4096;
+	size_t rangeReads = 1000;		//Number of random ranges decompressed from each corpus
+	string textPath;				//Empty to search for test.txt
+	string binaryPath;				//Empty to use the benchmark executable
+	unsigned int samples = 5;
+	unsigned int streamCount = 1;
+	unsigned int threadCount = 1;
+	bool csv = false;
+};
+
+//Time of a stage over a whole corpus
+struct SMeasurement
+{
+	double seconds = 0;
+	double cycles = 0;				//0 if the cycle counter cannot be read
+};
+
+//A block of a corpus and the results of each stage on it
+struct SBlock
+{
+	const uint8_t* text = nullptr;
+	size_t size = 0;
+
+	uint32_t counts[HuffmanCodeTable::size] = {};
+	uint8_t lengths[HuffmanCodeTable::size] = {};
+	HuffmanCodeTable table;
+	HuffmanDecodeTable decodeTable;
+
+	BitWriter header;				//Serialized code table
+	BitWriter symbols;				//Encoded characters without the code table
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//Number of heap allocations made by the benchmark
+static atomic<size_t> allocationCount(0);
+
+void* operator new(size_t size)
+{
+	allocationCount++;
+
+	if (void* memory = malloc(size ? size : 1))
+		return memory;
+
+	throw bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+	free(memory);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static uint64_t readCycles()
+{
+#ifdef HUFFMAN_BENCHMARK_RDTSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+//Generates the same sequence of numbers on every platform, unlike the standard library distributions
+class Random
+{
+public:
+
+	uint64_t next()
+	{
+		m_state ^= m_state >> 12;
+		m_state ^= m_state << 25;
+		m_state ^= m_state >> 27;
+		return m_state * 0x2545F4914F6CDD1Dull;
+	}
+
+private:
+
+	uint64_t m_state = 0x9E3779B97F4A7C15ull;
+};
+
+//Parses a size such as 100, 10K, 1M or 1G
+static bool parseSize(const string& name, size_t& size)
+{
+	char* end = nullptr;
+	uint64_t value = strtoull(name.c_str(), &end, 10);
+
+	const string suffixes = "KMG";
+	const size_t suffix = (*end != '\0') ? suffixes.find(*end++) : string::npos;
+
+	if (suffix != string::npos)
+		value <<= 10 * (suffix + 1);
+
+	if (*end != '\0' || value == 0 || value > SIZE_MAX)
+		return false;
+
+	size = (size_t)value;
+	return true;
+}
+
+static vector<string> split(const string& str, char delim)
+{
+	vector<string> tokens;
+	stringstream stream(str);
+	string token;
+
+	while (getline(stream, token, delim))
+	{
+		if (!token.empty())
+			tokens.push_back(token);
+	}
+
+	return tokens;
+}
+
+static bool readFile(const string& path, vector<uint8_t>& contents)
+{
+	ifstream file(path, ios::binary);
+
+	if (!file.is_open())
+		return false;
+
+	contents.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+
+	return !contents.empty();
+}
+
+//Fills a corpus of size bytes by repeating the contents of a file
+static void tile(const vector<uint8_t>& source, uint8_t* corpus, size_t size)
+{
+	for (size_t i = 0; i < size; i += source.size())
+		memcpy(corpus + i, source.data(), min(source.size(), size - i));
+}
+
+//Fills size bytes of memory with a corpus, returns false if its source file cannot be read
+static bool fillCorpus(const string& name, const vector<uint8_t>& textFile, const vector<uint8_t>& binaryFile, uint8_t* corpus, size_t size)
+{
+	Random random;
+
+	if (name == "text")
+	{
+		if (textFile.empty())
+			return false;
+
+		tile(textFile, corpus, size);
+	}
+	else if (name == "binary")
+	{
+		if (binaryFile.empty())
+			return false;
+
+		tile(binaryFile, corpus, size);
+	}
+	else if (name == "random")
+	{
+		for (size_t i = 0; i < size; i++)
+			corpus[i] = (uint8_t)(random.next() >> 56);
+	}
+	else if (name == "skewed")
+	{
+		//Each character is half as likely as the one before it
+		for (size_t i = 0; i < size; i++)
+		{
+			uint64_t bits = random.next();
+			uint8_t ch = 'a';
+
+			while ((bits & 1) && ch < 'z')
+			{
+				bits >>= 1;
+				ch++;
+			}
+
+			corpus[i] = ch;
+		}
+	}
+	else if (name == "single")
+	{
+		memset(corpus, 'a', size);
+	}
+	else
+	{
+		return false;
+	}
+
+	return true;
+}
+
+//Builds a corpus of size bytes, returns false if its source file cannot be read
+static bool makeCorpus(const string& name, const vector<uint8_t>& textFile, const vector<uint8_t>& binaryFile, size_t size, vector<uint8_t>& corpus)
+{
+	corpus.resize(size);
+
+	return fillCorpus(name, textFile, binaryFile, corpus.data(), size);
+}
+
+//Times a stage, run is repeated until a sample takes long enough to time and the fastest of several samples is kept
+static SMeasurement measure(unsigned int samples, const function<void()>& run)
+{
+	const double minSampleTime = 0.02;
+
+	//Calibrate the number of runs in a sample
+	size_t runs = 1;
+
+	while (true)
+	{
+		const steady_clock::time_point start = steady_clock::now();
+
+		for (size_t i = 0; i < runs; i++)
+			run();
+
+		if (duration<double>(steady_clock::now() - start).count() >= minSampleTime || runs >= ((size_t)1 << 30))
+			break;
+
+		runs *= 2;
+	}
+
+	SMeasurement best;
+	best.seconds = 1e300;
+
+	for (unsigned int s = 0; s < samples; s++)
+	{
+		const uint64_t cycleStart = readCycles();
+		const steady_clock::time_point start = steady_clock::now();
+
+		for (size_t i = 0; i < runs; i++)
+			run();
+
+		const double seconds = duration<double>(steady_clock::now() - start).count() / runs;
+		const double cycles = (double)(readCycles() - cycleStart) / runs;
+
+		if (seconds < best.seconds)
+		{
+			best.seconds = seconds;
+			best.cycles = cycles;
+		}
+	}
+
+	return best;
+}
+
+static void printMeasurement(const SBenchmarkArguments& args, const string& corpus, const string& sizeName, size_t size, const char* stage, const SMeasurement& m, double ratio)
+{
+	const double mbps = (double)size / (1024.0 * 1024.0) / m.seconds;
+	const double cyclesPerByte = m.cycles / (double)size;
+
+	if (args.csv)
+	{
+		printf("%s,%s,%s,%.2f,", corpus.c_str(), sizeName.c_str(), stage, mbps);
+
+		if (m.cycles > 0)
+			printf("%.3f", cyclesPerByte);
+
+		printf(",");
+
+		if (ratio > 0)
+			printf("%.4f", ratio);
+
+		printf("\n");
+	}
+	else
+	{
+		printf("%-8s %6s  %-12s %10.2f", corpus.c_str(), sizeName.c_str(), stage, mbps);
+
+		if (m.cycles > 0)
+			printf(" %10.2f", cyclesPerByte);
+		else
+			printf(" %10s", "-");
+
+		if (ratio > 0)
+			printf(" %8.4f", ratio);
+
+		printf("\n");
+	}
+
+	fflush(stdout);
+}
+
+static bool parseArguments(int argc, char** argv, SBenchmarkArguments& args)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		const string arg = argv[i];
+		const bool hasParam = (i + 1) < argc;
+
+		if (arg == "--csv")
+		{
+			args.csv = true;
+		}
+		else if (!hasParam)
+		{
+			cerr << arg << " must have one parameter\n";
+			return false;
+		}
+		else if (arg == "--sizes")
+		{
+			args.sizeNames = split(argv[++i], ',');
+		}
+		else if (arg == "--corpora")
+		{
+			args.corpora = split(argv[++i], ',');
+
+			for (const string& name : args.corpora)
+			{
+				if (name != "text" && name != "random" && name != "skewed" && name != "single" && name != "binary")
+				{
+					cerr << "Unknown corpus " << name << "\n";
+					return false;
+				}
+			}
+		}
+		else if (arg == "--text")
+		{
+			args.textPath = argv[++i];
+		}
+		else if (arg == "--binary")
+		{
+			args.binaryPath = argv[++i];
+		}
+		else if (arg == "--samples")
+		{
+			args.samples = max(1u, (unsigned int)strtoul(argv[++i], nullptr, 10));
+		}
+		else if (arg == "--streams")
+		{
+			args.streamCount = (unsigned int)strtoul(argv[++i], nullptr, 10);
+
+			if (args.streamCount == 0 || args.streamCount > HUFFMAN_MAX_STREAM_COUNT)
+			{
+				cerr << "--streams must be between 1 and " << HUFFMAN_MAX_STREAM_COUNT << "\n";
+				return false;
+			}
+		}
+		else if (arg == "--threads")
+		{
+			args.threadCount = (unsigned int)strtoul(argv[++i], nullptr, 10);
+		}
+		else if (arg == "--records")
+		{
+			args.recordSizeNames = split(argv[++i], ',');
+		}
+		else if (arg == "--batch")
+		{
+			args.batchSize = max((size_t)1, (size_t)strtoull(argv[++i], nullptr, 10));
+		}
+		else if (arg == "--levels")
+		{
+			args.levels.clear();
+
+			for (const string& level : split(argv[++i], ','))
+			{
+				args.levels.push_back((unsigned int)strtoul(level.c_str(), nullptr, 10));
+
+				if (args.levels.back() < HUFFMAN_MIN_LEVEL || args.levels.back() > HUFFMAN_MAX_LEVEL)
+				{
+					cerr << "--levels must be between " << HUFFMAN_MIN_LEVEL << " and " << HUFFMAN_MAX_LEVEL << "\n";
+					return false;
+				}
+			}
+		}
+		else if (arg == "--ranges")
+		{
+			args.rangeSizeNames = split(argv[++i], ',');
+		}
+		else if (arg == "--range-length")
+		{
+			args.rangeLengthName = argv[++i];
+		}
+		else if (arg == "--checkpoints")
+		{
+			args.checkpointInterval = (size_t)strtoull(argv[++i], nullptr, 10);
+
+			if (args.checkpointInterval == 0 || HUFFMAN_DEFAULT_BLOCK_SIZE % args.checkpointInterval)
+			{
+				cerr << "--checkpoints must divide the block size of " << HUFFMAN_DEFAULT_BLOCK_SIZE << "\n";
+				return false;
+			}
+		}
+		else if (arg == "--reads")
+		{
+			args.rangeReads = max((size_t)1, (size_t)strtoull(argv[++i], nullptr, 10));
+		}
+		else
+		{
+			cerr << "Unknown argument " << arg << "\n";
+			return false;
+		}
+	}
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//Checks that the largest code table, whose characters alternate between having a code of 32 bits and having none,
+//takes the bits it is expected to and fits in the bound of an empty block
+static bool checkLargestTable()
+{
+	uint8_t lengths[HuffmanCodeTable::size] = {};
+
+	//127 codes of 7 bits leave room for one of 32 bits
+	for (size_t ch = 0; ch < HuffmanCodeTable::size; ch += 2)
+		lengths[ch] = (ch == 0) ? HuffmanCodeTable::maxCodeLength : 7;
+
+	HuffmanCodeTable table;
+	HuffmanCodeTable readTable;
+
+	if (!table.buildCanonical(lengths))
+		return false;
+
+	BitWriter writer;
+	table.serialize(writer);
+	writer.flush();
+
+	BitReader reader(writer.getBitBuffer(), writer.getBitCount());
+
+	return writer.getBitCount() == HuffmanCodeTable::maxSerializedBits && table.getSerializedBits() == writer.getBitCount() &&
+		writer.getByteCount() <= huffmanBlockBound(0) && readTable.deserialize(reader);
+}
+
+//Checks that empty text round trips as single buffer encoded text, through a stream and through a buffer
+static bool checkEmptyText()
+{
+	stringstream encoded;
+	stringstream decoded;
+
+	if (!huffmanCompress(string(), encoded) || !huffmanDecompress(encoded, decoded) || !decoded.str().empty())
+		return false;
+
+	const string encodedText = encoded.str();
+	uint8_t text = 0;
+	size_t textSize = 1;
+
+	return huffmanDecompressBuffer(reinterpret_cast<const uint8_t*>(encodedText.data()), encodedText.size(), &text, 0, textSize) && textSize == 0;
+}
+
+//Measures every stage on one corpus, returns false if a stage fails or does not reproduce the corpus
+static bool benchmarkCorpus(const SBenchmarkArguments& args, const string& name, const string& sizeName, const vector<uint8_t>& corpus)
+{
+	const size_t size = corpus.size();
+	const size_t blockSize = HUFFMAN_DEFAULT_BLOCK_SIZE;
+
+	vector<SBlock> blocks((size + blockSize - 1) / blockSize);
+
+	for (size_t i = 0; i < blocks.size(); i++)
+	{
+		SBlock& block = blocks[i];
+		block.text = corpus.data() + i * blockSize;
+		block.size = min(blockSize, size - i * blockSize);
+		block.symbols = BitWriter(huffmanBlockBound(block.size) * CHAR_BIT);
+	}
+
+	vector<uint8_t> decoded(size);
+	bool valid = true;
+
+	//Histogram of each block
+	const SMeasurement histogram = measure(args.samples, [&]()
+	{
+		for (SBlock& block : blocks)
+			huffmanHistogram(block.text, block.size, block.counts);
+	});
+
+	//Code lengths of each block, which take the place of building a tree
+	const SMeasurement tree = measure(args.samples, [&]()
+	{
+		for (SBlock& block : blocks)
+		{
+			valid &= huffmanCodeLengths(block.counts, block.lengths);
+
+			if (*max_element(begin(block.lengths), end(block.lengths)) > HuffmanCodeTable::defaultLengthLimit)
+				valid &= huffmanLimitedCodeLengths(block.counts, HuffmanCodeTable::defaultLengthLimit, block.lengths);
+		}
+	});
+
+	//Canonical codes and decoding table of each block
+	const SMeasurement table = measure(args.samples, [&]()
+	{
+		for (SBlock& block : blocks)
+		{
+			valid &= block.table.buildCanonical(block.lengths);
+			valid &= block.decodeTable.build(block.table);
+		}
+	});
+
+	//Characters of each block, encoded without the code table
+	const SMeasurement encode = measure(args.samples, [&]()
+	{
+		for (SBlock& block : blocks)
+		{
+			block.symbols.clear();
+
+			for (size_t i = 0; i < block.size; i++)
+			{
+				const SHuffmanCode& code = block.table[block.text[i]];
+				block.symbols.write(code.pattern, code.length);
+			}
+
+			block.symbols.flush();
+		}
+	});
+
+	//Code table of each block, written and read back
+	const SMeasurement header = measure(args.samples, [&]()
+	{
+		for (SBlock& block : blocks)
+		{
+			block.header.clear();
+			block.table.serialize(block.header);
+			block.header.flush();
+
+			BitReader reader(block.header.getBitBuffer(), block.header.getBitCount());
+			HuffmanCodeTable readTable;
+			valid &= readTable.deserialize(reader);
+		}
+	});
+
+	//Characters of each block, decoded with the decoding table
+	const SMeasurement decode = measure(args.samples, [&]()
+	{
+		uint8_t* out = decoded.data();
+
+		for (const SBlock& block : blocks)
+		{
+			BitReader reader(block.symbols.getBitBuffer(), block.symbols.getBitCount());
+
+			for (size_t i = 0; i < block.size; i++)
+				valid &= block.decodeTable.decode(reader, out[i]);
+
+			out += block.size;
+		}
+	});
+
+	if (!valid || decoded != corpus)
+	{
+		cerr << "Stages did not reproduce the " << name << " corpus of " << sizeName << "B\n";
+		return false;
+	}
+
+	//Whole codec through the public interface
+	SHuffmanOptions options;
+	options.streamCount = args.streamCount;
+	options.threadCount = args.threadCount;
+
+	//Encoded text is written to a buffer of the bound size
+	vector<uint8_t> encoded(huffmanCompressBound(size, options));
+	size_t encodedSize = 0;
+
+	const SMeasurement compress = measure(args.samples, [&]()
+	{
+		valid &= huffmanCompressBuffer(corpus.data(), size, encoded.data(), encoded.size(), encodedSize, options);
+	});
+
+	fill(decoded.begin(), decoded.end(), 0);
+	size_t decodedSize = 0;
+
+	const SMeasurement decompress = measure(args.samples, [&]()
+	{
+		valid &= huffmanDecompressBuffer(encoded.data(), encodedSize, decoded.data(), decoded.size(), decodedSize, options);
+	});
+
+	if (!valid || decodedSize != size || decoded != corpus)
+	{
+		cerr << "Codec did not reproduce the " << name << " corpus of " << sizeName << "B\n";
+		return false;
+	}
+
+	//Same codec through contexts reused for every call, as for many small messages
+	HuffmanEncoder encoder(options);
+	HuffmanDecoder decoder(options);
+	vector<uint8_t> contextEncoded;
+
+	const SMeasurement encoderContext = measure(args.samples, [&]()
+	{
+		valid &= encoder.compress(corpus.data(), size, contextEncoded);
+	});
+
+	fill(decoded.begin(), decoded.end(), 0);
+
+	const SMeasurement decoderContext = measure(args.samples, [&]()
+	{
+		valid &= decoder.decompress(contextEncoded.data(), contextEncoded.size(), decoded.data(), decoded.size(), decodedSize);
+	});
+
+	if (!valid || contextEncoded.size() != encodedSize || decodedSize != size || decoded != corpus)
+	{
+		cerr << "Contexts did not reproduce the " << name << " corpus of " << sizeName << "B\n";
+		return false;
+	}
+
+	//Corpus as a single message compressed with a dictionary trained on the corpus itself
+	HuffmanDictionary dictionary;
+	valid &= dictionary.train(corpus.data(), size);
+
+	vector<uint8_t> message(huffmanDictionaryCompressBound(size, dictionary));
+	size_t messageSize = 0;
+
+	const SMeasurement dictionaryCompress = measure(args.samples, [&]()
+	{
+		valid &= encoder.compress(corpus.data(), size, dictionary, message.data(), message.size(), messageSize);
+	});
+
+	fill(decoded.begin(), decoded.end(), 0);
+
+	const SMeasurement dictionaryDecompress = measure(args.samples, [&]()
+	{
+		valid &= huffmanDecompressWithDictionary(message.data(), messageSize, dictionary, decoded.data(), decoded.size(), decodedSize);
+	});
+
+	if (!valid || decodedSize != size || decoded != corpus)
+	{
+		cerr << "Dictionary did not reproduce the " << name << " corpus of " << sizeName << "B\n";
+		return false;
+	}
+
+	//Contexts have grown to fit the corpus, coding it again must not allocate
+	const size_t allocations = allocationCount;
+
+	valid &= encoder.compress(corpus.data(), size, contextEncoded);
+	valid &= decoder.decompress(contextEncoded.data(), contextEncoded.size(), decoded.data(), decoded.size(), decodedSize);
+	valid &= encoder.compress(corpus.data(), size, dictionary, message.data(), message.size(), messageSize);
+	valid &= huffmanDecompressWithDictionary(message.data(), messageSize, dictionary, decoded.data(), decoded.size(), decodedSize);
+
+	if (!valid || allocationCount != allocations)
+	{
+		cerr << "Contexts made " << (allocationCount - allocations) << " allocations coding the " << name << " corpus of " << sizeName << "B again\n";
+		return false;
+	}
+
+	const double ratio = (double)encodedSize / size;
+
+	printMeasurement(args, name, sizeName, size, "histogram", histogram, 0);
+	printMeasurement(args, name, sizeName, size, "tree", tree, 0);
+	printMeasurement(args, name, sizeName, size, "table", table, 0);
+	printMeasurement(args, name, sizeName, size, "encode", encode, 0);
+	printMeasurement(args, name, sizeName, size, "header", header, 0);
+	printMeasurement(args, name, sizeName, size, "decode", decode, 0);
+	printMeasurement(args, name, sizeName, size, "compress", compress, ratio);
+	printMeasurement(args, name, sizeName, size, "decompress", decompress, 0);
+	printMeasurement(args, name, sizeName, size, "encoder", encoderContext, 0);
+	printMeasurement(args, name, sizeName, size, "decoder", decoderContext, 0);
+	printMeasurement(args, name, sizeName, size, "dict-comp", dictionaryCompress, (double)messageSize / size);
+	printMeasurement(args, name, sizeName, size, "dict-decomp", dictionaryDecompress, 0);
+
+	return true;
+}
+
+static void printBatchMeasurement(const SBenchmarkArguments& args, const string& corpus, const string& recordSizeName, size_t batchBytes, const char* stage, const SMeasurement& m, double ratio)
+{
+	const double recordsPerSecond = (double)args.batchSize / m.seconds;
+	const double mbps = (double)batchBytes / (1024.0 * 1024.0) / m.seconds;
+
+	if (args.csv)
+	{
+		printf("%s,%s,%s,%.0f,%.2f,", corpus.c_str(), recordSizeName.c_str(), stage, recordsPerSecond, mbps);
+
+		if (ratio > 0)
+			printf("%.4f", ratio);
+
+		printf("\n");
+	}
+	else
+	{
+		printf("%-8s %6s  %-14s %12.0f %10.2f", corpus.c_str(), recordSizeName.c_str(), stage, recordsPerSecond, mbps);
+
+		if (ratio > 0)
+			printf(" %8.4f", ratio);
+
+		printf("\n");
+	}
+
+	fflush(stdout);
+}
+
+//Measures the batch functions on records of recordSize bytes cut from a corpus, returns false if a batch is not reproduced
+static bool benchmarkBatch(const SBenchmarkArguments& args, const string& name, const string& recordSizeName, const vector<uint8_t>& corpus)
+{
+	const size_t recordSize = corpus.size() / args.batchSize;
+
+	SHuffmanOptions options;
+	options.streamCount = args.streamCount;
+	options.threadCount = args.threadCount;
+
+	vector<SHuffmanSpan> records(args.batchSize);
+
+	for (size_t i = 0; i < records.size(); i++)
+	{
+		records[i].data = corpus.data() + i * recordSize;
+		records[i].size = recordSize;
+	}
+
+	SHuffmanRecords encoded;
+	SHuffmanRecords decoded;
+	HuffmanDictionary sharedTable;
+	bool valid = true;
+
+	const SMeasurement compress = measure(args.samples, [&]()
+	{
+		valid &= huffmanCompressBatch(records, encoded, options);
+	});
+
+	const double ratio = (double)encoded.data.size() / corpus.size();
+
+	const SMeasurement decompress = measure(args.samples, [&]()
+	{
+		valid &= huffmanDecompressBatch(encoded, decoded, options);
+	});
+
+	if (!valid || decoded.count() != records.size() || decoded.data != corpus)
+	{
+		cerr << "Batch did not reproduce the " << name << " records of " << recordSizeName << "B\n";
+		return false;
+	}
+
+	const SMeasurement sharedCompress = measure(args.samples, [&]()
+	{
+		valid &= huffmanCompressBatch(records, encoded, options, &sharedTable);
+	});
+
+	const double sharedRatio = (double)encoded.data.size() / corpus.size();
+
+	const SMeasurement sharedDecompress = measure(args.samples, [&]()
+	{
+		valid &= huffmanDecompressBatch(encoded, decoded, options, &sharedTable);
+	});
+
+	if (!valid || decoded.count() != records.size() || decoded.data != corpus)
+	{
+		cerr << "Shared table batch did not reproduce the " << name << " records of " << recordSizeName << "B\n";
+		return false;
+	}
+
+	printBatchMeasurement(args, name, recordSizeName, corpus.size(), "batch-comp", compress, ratio);
+	printBatchMeasurement(args, name, recordSizeName, corpus.size(), "batch-decomp", decompress, 0);
+	printBatchMeasurement(args, name, recordSizeName, corpus.size(), "shared-comp", sharedCompress, sharedRatio);
+	printBatchMeasurement(args, name, recordSizeName, corpus.size(), "shared-decomp", sharedDecompress, 0);
+
+	return true;
+}
+
+static void printLevelMeasurement(const SBenchmarkArguments& args, const string& corpus, const string& sizeName, size_t size, unsigned int level,
+	const SMeasurement& compress, const SMeasurement& decompress, double ratio)
+{
+	const double compressMbps = (double)size / (1024.0 * 1024.0) / compress.seconds;
+	const double decompressMbps = (double)size / (1024.0 * 1024.0) / decompress.seconds;
+
+	if (args.csv)
+		printf("%s,%s,%u,%.2f,%.2f,%.4f\n", corpus.c_str(), sizeName.c_str(), level, compressMbps, decompressMbps, ratio);
+	else
+		printf("%-8s %6s  %5u %12.2f %12.2f %8.4f\n", corpus.c_str(), sizeName.c_str(), level, compressMbps, decompressMbps, ratio);
+
+	fflush(stdout);
+}
+
+//Measures compressing and decompressing a corpus at every level, returns false if a level does not reproduce the corpus
+static bool benchmarkLevels(const SBenchmarkArguments& args, const string& name, const string& sizeName, const vector<uint8_t>& corpus)
+{
+	const size_t size = corpus.size();
+
+	SHuffmanOptions options;
+	options.streamCount = args.streamCount;
+	options.threadCount = args.threadCount;
+
+	vector<uint8_t> encoded;
+	vector<uint8_t> decoded(size);
+
+	for (unsigned int level : args.levels)
+	{
+		options.level = level;
+		encoded.resize(huffmanCompressBound(size, options));
+
+		size_t encodedSize = 0;
+		size_t decodedSize = 0;
+		bool valid = true;
+
+		const SMeasurement compress = measure(args.samples, [&]()
+		{
+			valid &= huffmanCompressBuffer(corpus.data(), size, encoded.data(), encoded.size(), encodedSize, options);
+		});
+
+		fill(decoded.begin(), decoded.end(), 0);
+
+		const SMeasurement decompress = measure(args.samples, [&]()
+		{
+			valid &= huffmanDecompressBuffer(encoded.data(), encodedSize, decoded.data(), decoded.size(), decodedSize, options);
+		});
+
+		if (!valid || decodedSize != size || decoded != corpus)
+		{
+			cerr << "Level " << level << " did not reproduce the " << name << " corpus of " << sizeName << "B\n";
+			return false;
+		}
+
+		printLevelMeasurement(args, name, sizeName, size, level, compress, decompress, (double)encodedSize / size);
+	}
+
+	return true;
+}
+
+//Files the range corpora and their encoded text are mapped from, in the working directory
+static const char* const rangeCorpusPath = "huffmanBenchmark.corpus";
+static const char* const rangeEncodedPath = "huffmanBenchmark.huf";
+
+static void printRangeMeasurement(const SBenchmarkArguments& args, const string& corpus, const string& sizeName, const char* mode, double seconds, double ratio)
+{
+	if (args.csv)
+		printf("%s,%s,%s,%s,%.2f,%.4f\n", corpus.c_str(), sizeName.c_str(), args.rangeLengthName.c_str(), mode, seconds * 1e6, ratio);
+	else
+		printf("%-8s %6s  %6s  %-12s %12.2f %8.4f\n", corpus.c_str(), sizeName.c_str(), args.rangeLengthName.c_str(), mode, seconds * 1e6, ratio);
+
+	fflush(stdout);
+}
+
+//Measures the mean latency of decompressing random ranges of rangeLength bytes from a corpus compressed with and
+//without checkpoints, returns false if a range does not match the corpus
+//The encoded corpus is written to a file and mapped, so only the pages a range reads are brought into memory
+static bool benchmarkRanges(const SBenchmarkArguments& args, const string& name, const string& sizeName, size_t rangeLength, const uint8_t* corpus, size_t size)
+{
+	SHuffmanOptions options;
+	options.threadCount = args.threadCount;
+
+	//Ranges start at the same offsets in both modes
+	vector<uint64_t> starts(args.rangeReads);
+	Random random;
+
+	for (uint64_t& start : starts)
+		start = (size > rangeLength) ? random.next() % (size - rangeLength + 1) : 0;
+
+	//Ranges are compared with the corpus once timed, as reading the corpus would be timed with them
+	vector<uint8_t> ranges(starts.size() * rangeLength);
+	vector<size_t> rangeSizes(starts.size());
+
+	for (size_t interval : { (size_t)0, args.checkpointInterval })
+	{
+		options.checkpointInterval = interval;
+
+		ofstream encodedFile(rangeEncodedPath, ios::binary | ios::trunc);
+
+		if (!huffmanCompressStream(corpus, size, encodedFile, options) || !encodedFile.flush())
+		{
+			cerr << "Unable to compress the " << name << " corpus of " << sizeName << "B to " << rangeEncodedPath << "\n";
+			encodedFile.close();
+			remove(rangeEncodedPath);
+			return false;
+		}
+
+		encodedFile.close();
+
+		MappedFile encoded;
+
+		if (!encoded.openRead(rangeEncodedPath))
+		{
+			cerr << "Unable to map " << rangeEncodedPath << "\n";
+			remove(rangeEncodedPath);
+			return false;
+		}
+
+		const size_t encodedSize = encoded.size();
+		const steady_clock::time_point start = steady_clock::now();
+
+		size_t decoded = 0;
+
+		while (decoded < starts.size() && huffmanDecompressRange(encoded.data(), encodedSize, starts[decoded], rangeLength,
+			ranges.data() + decoded * rangeLength, rangeSizes[decoded]))
+			decoded++;
+
+		const double seconds = duration<double>(steady_clock::now() - start).count() / starts.size();
+
+		encoded.close();
+		remove(rangeEncodedPath);
+
+		for (size_t i = 0; i < starts.size(); i++)
+		{
+			if (i >= decoded || rangeSizes[i] != min(rangeLength, size) || memcmp(ranges.data() + i * rangeLength, corpus + starts[i], rangeSizes[i]) != 0)
+			{
+				cerr << "Range " << starts[i] << " of the " << name << " corpus of " << sizeName << "B was not reproduced\n";
+				return false;
+			}
+		}
+
+		printRangeMeasurement(args, name, sizeName, interval ? "checkpoints" : "blocks", seconds, (double)encodedSize / size);
+	}
+
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	SBenchmarkArguments args;
+
+	if (!parseArguments(argc, argv, args))
+		return 1;
+
+	//Errors of the codec explain why a corpus did not round trip
+	const HuffmanErrorCallback printError = [](const string& message)
+	{
+		cerr << message << "\n";
+	};
+
+	HuffmanErrorScope errors(printError);
+
+	vector<size_t> sizes;
+
+	for (const string& sizeName : args.sizeNames)
+	{
+		size_t size = 0;
+
+		if (!parseSize(sizeName, size))
+		{
+			cerr << "Invalid size " << sizeName << "\n";
+			return 1;
+		}
+
+		sizes.push_back(size);
+	}
+
+	vector<size_t> recordSizes;
+
+	for (const string& recordSizeName : args.recordSizeNames)
+	{
+		size_t size = 0;
+
+		if (!parseSize(recordSizeName, size) || size == 0)
+		{
+			cerr << "Invalid record size " << recordSizeName << "\n";
+			return 1;
+		}
+
+		recordSizes.push_back(size);
+	}
+
+	size_t rangeLength = 0;
+
+	if (!parseSize(args.rangeLengthName, rangeLength) || rangeLength == 0)
+	{
+		cerr << "Invalid range length " << args.rangeLengthName << "\n";
+		return 1;
+	}
+
+	vector<size_t> rangeSizes;
+
+	for (const string& rangeSizeName : args.rangeSizeNames)
+	{
+		size_t size = 0;
+
+		if (!parseSize(rangeSizeName, size) || size == 0)
+		{
+			cerr << "Invalid range size " << rangeSizeName << "\n";
+			return 1;
+		}
+
+		rangeSizes.push_back(size);
+	}
+
+	if (!checkLargestTable())
+	{
+		cerr << "Largest code table does not fit in the block bound\n";
+		return 1;
+	}
+
+	if (!checkEmptyText())
+	{
+		cerr << "Empty text did not round trip\n";
+		return 1;
+	}
+
+	//Source files of the tiled corpora, test.txt is searched for from the usual build directories
+	vector<uint8_t> textFile;
+	vector<uint8_t> binaryFile;
+
+	if (args.textPath.empty())
+	{
+		for (const char* path : { "test.txt", "../test.txt", "../../test.txt" })
+		{
+			if (readFile(path, textFile))
+				break;
+		}
+	}
+	else
+	{
+		readFile(args.textPath, textFile);
+	}
+
+	readFile(args.binaryPath.empty() ? string(argv[0]) : args.binaryPath, binaryFile);
+
+	if (args.csv)
+		printf("corpus,size,stage,mb_per_s,cycles_per_byte,ratio\n");
+	else
+		printf("%-8s %6s  %-12s %10s %10s %8s\n", "corpus", "size", "stage", "MB/s", "cycles/B", "ratio");
+
+	vector<uint8_t> corpus;
+
+	for (const string& name : args.corpora)
+	{
+		for (size_t i = 0; i < sizes.size(); i++)
+		{
+			if (!makeCorpus(name, textFile, binaryFile, sizes[i], corpus))
+			{
+				cerr << "Skipping the " << name << " corpus, its source could not be read\n";
+				break;
+			}
+
+			if (!benchmarkCorpus(args, name, args.sizeNames[i], corpus))
+				return 1;
+		}
+	}
+
+	if (!recordSizes.empty())
+	{
+		if (args.csv)
+			printf("\ncorpus,record_size,stage,records_per_s,mb_per_s,ratio\n");
+		else
+			printf("\n%-8s %6s  %-14s %12s %10s %8s\n", "corpus", "record", "stage", "records/s", "MB/s", "ratio");
+
+		for (const string& name : args.corpora)
+		{
+			for (size_t i = 0; i < recordSizes.size(); i++)
+			{
+				if (!makeCorpus(name, textFile, binaryFile, recordSizes[i] * args.batchSize, corpus))
+					break;
+
+				if (!benchmarkBatch(args, name, args.recordSizeNames[i], corpus))
+					return 1;
+			}
+		}
+	}
+
+	if (!args.levels.empty())
+	{
+		if (args.csv)
+			printf("\ncorpus,size,level,compress_mb_per_s,decompress_mb_per_s,ratio\n");
+		else
+			printf("\n%-8s %6s  %5s %12s %12s %8s\n", "corpus", "size", "level", "comp MB/s", "decomp MB/s", "ratio");
+
+		for (const string& name : args.corpora)
+		{
+			for (size_t i = 0; i < sizes.size(); i++)
+			{
+				if (!makeCorpus(name, textFile, binaryFile, sizes[i], corpus))
+					break;
+
+				if (!benchmarkLevels(args, name, args.sizeNames[i], corpus))
+					return 1;
+			}
+		}
+	}
+
+	if (rangeSizes.empty())
+		return 0;
+
+	if (args.csv)
+		printf("\ncorpus,size,range,mode,us_per_range,ratio\n");
+	else
+		printf("\n%-8s %6s  %6s  %-12s %12s %8s\n", "corpus", "size", "range", "mode", "us/range", "ratio");
+
+	for (const string& name : args.corpora)
+	{
+		for (size_t i = 0; i < rangeSizes.size(); i++)
+		{
+			//Range corpora are mapped from a file, so sizes larger than memory can be read
+			MappedFile rangeCorpus;
+
+			if (!rangeCorpus.create(rangeCorpusPath, rangeSizes[i]))
+			{
+				cerr << "Unable to create " << rangeCorpusPath << "\n";
+				return 1;
+			}
+
+			const bool filled = fillCorpus(name, textFile, binaryFile, rangeCorpus.data(), rangeSizes[i]);
+			const bool success = filled && benchmarkRanges(args, name, args.rangeSizeNames[i], rangeLength, rangeCorpus.data(), rangeSizes[i]);
+
+			rangeCorpus.close();
+			remove(rangeCorpusPath);
+
+			if (!filled)
+				break;
+
+			if (!success)
+				return 1;
+		}
+	}
+
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////